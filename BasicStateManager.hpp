@@ -0,0 +1,335 @@
+/**
+ * @brief A state manager whose features are chosen at compile time with policies.
+ * @author Honzik Schenk
+ *
+ * BasicStateManager runs states the same way as StateManager (the active
+ * state's function on every tick, then the first state whose transition
+ * function returns true), but threading, instrumentation, storage, the
+ * callback type and the width of state ids are template parameters (see
+ * StatePolicies.hpp). With the default policies a tick is an indirect call
+ * and nothing else, and the state manager is only its states and the id of
+ * the active state. Everything is defined in this header, so ticks can be
+ * inlined into the caller's loop.
+ *
+ * The transition functions take the name of the active state like those of
+ * StateManager, so the same functions work with both. Use StateManager for
+ * the rest of the features (metrics, hierarchy, events, hot reload, ...):
+ * it stays a regular class, whose optional features are compiled in or out
+ * with STATEMANAGER_FEATURES instead (see StateManagerFeatures.hpp).
+ */
+
+#ifndef BASICSTATEMANAGER_HPP
+#define BASICSTATEMANAGER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+#include "StatePolicies.hpp"
+
+using namespace std;
+
+template <typename Threading = SingleThreaded, typename Instrumentation = NoInstrumentation, typename Storage = DynamicStorage, typename Callbacks = FunctionPointerCallbacks, typename Id = uint32_t>
+class BasicStateManager : private Threading, private Instrumentation
+{
+public:
+    typedef typename Callbacks::StateFunction StateFunction;
+    typedef typename Callbacks::TransitionFunction TransitionFunction;
+
+    static_assert(is_unsigned<Id>::value, "State ids have to be an unsigned integer type");
+
+    /**
+     * @brief The id of the active state when no state is active.
+     */
+    static const Id noState = numeric_limits<Id>::max();
+
+    struct State
+    {
+        string stateName;
+
+        StateFunction stateFunction;
+        TransitionFunction transitionToState;
+
+        State() : stateFunction(), transitionToState() {}
+    };
+
+    BasicStateManager() : activeState(noState) {}
+
+    /**
+     * @brief Run the active state.
+     * @return The return value of the state function, or false if no state is active or it has no state function.
+     */
+    bool run()
+    {
+        typename Threading::Lock lock(*this);
+
+        return tick();
+    }
+
+    /**
+     * @brief Run the active state and (if flagged true) transition to the proper next state.
+     * @param transitionToo If true, the state manager will also transition to the next state.
+     * @return The return value of the state function, or false if no state is active or it has no state function.
+     */
+    bool run(bool transitionToo)
+    {
+        typename Threading::Lock lock(*this);
+
+        bool stateRan = tick();
+
+        if (transitionToo)
+        {
+            takeTransition();
+        }
+
+        return stateRan;
+    }
+
+    /**
+     * @brief Transition to the first state whose transition function returns true.
+     * @return True if a state was transitioned to, false if no state needed to be transitioned to.
+     */
+    bool transition()
+    {
+        typename Threading::Lock lock(*this);
+
+        return takeTransition();
+    }
+
+    /**
+     * @brief Transition to a specific state.
+     * @param stateName The name of the state to transition to.
+     * @return True if the state was found and transitioned to, false if the state was not found.
+     */
+    bool transition(const string &stateName)
+    {
+        typename Threading::Lock lock(*this);
+
+        size_t index = find(stateName);
+
+        if (index == noState)
+        {
+            return false;
+        }
+
+        enterState(index);
+
+        return true;
+    }
+
+    /**
+     * @brief Add a state.
+     * @param stateName The name of the new state.
+     * @return True if the state was added, false if it already exists or there is no room for another state.
+     */
+    bool addState(const string &stateName)
+    {
+        typename Threading::Lock lock(*this);
+
+        // The largest id is reserved for noState.
+        if (find(stateName) != noState || states.full() || states.size() >= static_cast<size_t>(noState))
+        {
+            return false;
+        }
+
+        State state;
+        state.stateName = stateName;
+
+        states.push_back(state);
+
+        return true;
+    }
+
+    /**
+     * @brief Remove a state.
+     * @param stateName The name of the state to remove.
+     * @return True if the state was removed, false if it was not found.
+     *
+     * @note Removing the active state leaves no state active until the next transition.
+     */
+    bool removeState(const string &stateName)
+    {
+        typename Threading::Lock lock(*this);
+
+        size_t index = find(stateName);
+
+        if (index == noState)
+        {
+            return false;
+        }
+
+        states.erase(index);
+
+        if (activeState == index)
+        {
+            activeState = noState;
+        }
+        else if (activeState != noState && activeState > index)
+        {
+            activeState--;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Set the function that is called while a state is active.
+     * @return True if the function was set, false if the state was not found.
+     */
+    bool setStateFunction(const string &stateName, StateFunction stateFunction)
+    {
+        typename Threading::Lock lock(*this);
+
+        size_t index = find(stateName);
+
+        if (index == noState)
+        {
+            return false;
+        }
+
+        states[index].stateFunction = stateFunction;
+
+        return true;
+    }
+
+    /**
+     * @brief Set the function deciding if a state should become active.
+     * @return True if the function was set, false if the state was not found.
+     */
+    bool setTransitionToState(const string &stateName, TransitionFunction transitionToState)
+    {
+        typename Threading::Lock lock(*this);
+
+        size_t index = find(stateName);
+
+        if (index == noState)
+        {
+            return false;
+        }
+
+        states[index].transitionToState = transitionToState;
+
+        return true;
+    }
+
+    /**
+     * @brief Get the name of the active state (empty if no state is active).
+     */
+    string getActiveStateName()
+    {
+        typename Threading::Lock lock(*this);
+
+        return activeState == noState ? string() : states[activeState].stateName;
+    }
+
+    /**
+     * @brief Get the number of states.
+     */
+    size_t size()
+    {
+        typename Threading::Lock lock(*this);
+
+        return states.size();
+    }
+
+    /**
+     * @brief Get the instrumentation policy (ex: the counters of CountingInstrumentation).
+     *
+     * @note Read the counters from the thread running the state manager, they are not synchronized.
+     */
+    const Instrumentation &getInstrumentation() const
+    {
+        return *this;
+    }
+
+private:
+    typename Storage::template Container<State> states;
+    Id activeState;
+
+    size_t find(const string &stateName) const
+    {
+        for (size_t i = 0; i < states.size(); i++)
+        {
+            if (states[i].stateName == stateName)
+            {
+                return i;
+            }
+        }
+
+        return noState;
+    }
+
+    bool tick()
+    {
+        Instrumentation::onTick();
+
+        if (activeState == noState || !states[activeState].stateFunction)
+        {
+            return false;
+        }
+
+        return states[activeState].stateFunction();
+    }
+
+    bool takeTransition()
+    {
+        static const string noStateName;
+
+        const string &activeName = activeState == noState ? noStateName : states[activeState].stateName;
+
+        for (size_t i = 0; i < states.size(); i++)
+        {
+            if (i == activeState || !states[i].transitionToState)
+            {
+                continue;
+            }
+
+            bool wantsToBecomeActive = states[i].transitionToState(activeName);
+
+            Instrumentation::onGuard(wantsToBecomeActive);
+
+            if (wantsToBecomeActive)
+            {
+                enterState(i);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void enterState(size_t index)
+    {
+        Instrumentation::onTransition(activeState, index);
+
+        activeState = static_cast<Id>(index);
+    }
+};
+
+template <typename Threading, typename Instrumentation, typename Storage, typename Callbacks, typename Id>
+const Id BasicStateManager<Threading, Instrumentation, Storage, Callbacks, Id>::noState;
+
+// The disabled features must not take any room in the state manager.
+static_assert(is_empty<SingleThreaded>::value && is_empty<NoInstrumentation>::value, "Disabled policies have to be empty");
+
+namespace basicStateManagerLayout
+{
+    struct Default
+    {
+        DynamicStorage::Container<BasicStateManager<>::State> states;
+        uint32_t activeState;
+    };
+
+    struct Fixed
+    {
+        FixedStorage<4>::Container<BasicStateManager<SingleThreaded, NoInstrumentation, FixedStorage<4>, FunctionPointerCallbacks, uint8_t>::State> states;
+        uint8_t activeState;
+    };
+}
+
+static_assert(sizeof(BasicStateManager<>) == sizeof(basicStateManagerLayout::Default), "The default policies must not add data");
+static_assert(sizeof(BasicStateManager<SingleThreaded, NoInstrumentation, FixedStorage<4>, FunctionPointerCallbacks, uint8_t>) == sizeof(basicStateManagerLayout::Fixed), "Fixed storage and 8-bit ids must not add data");
+
+#endif // BASICSTATEMANAGER_HPP
@@ -0,0 +1,363 @@
+// NOTE: This benchmark compares the cost of a tick for StateManager and several BasicStateManager configurations,
+// measures the throughput of StateDfa and the lookups of dense and compressed dispatch tables, and compares
+// ticking a fleet of instances one by one with StateMachine and bucket by bucket with StateFleet.
+// Add -DSTATEMANAGER_INLINE_DISPATCH to measure StateManager with run() and transition() inlined, and
+// -DSTATEMANAGER_FEATURES=0 to measure it with every optional feature compiled out (see StateManagerFeatures.hpp).
+// To run with gcc, use the following command: g++ -std=c++11 -O2 -pthread -o StateManagerBenchmark Benchmark.cpp StateManager.cpp StateArena.cpp StateBlackboard.cpp StateDefinition.cpp StateDefinitionDomain.cpp StateDfa.cpp StateDispatchTable.cpp StateEventQueue.cpp StateFleet.cpp StateGraph.cpp StateHistogram.cpp StateMachine.cpp StateMetrics.cpp StatePerfCounters.cpp && ./StateManagerBenchmark
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "BasicStateManager.hpp"
+#include "StateDfa.hpp"
+#include "StateDefinitionDomain.hpp"
+#include "StateDispatchTable.hpp"
+#include "StateFleet.hpp"
+#include "StateMachine.hpp"
+#include "StateManager.hpp"
+
+using namespace std;
+
+namespace
+{
+    const uint64_t ticks = 10000000;
+
+    volatile uint64_t work = 0;
+
+    bool stateFunction()
+    {
+        work = work + 1;
+        return true;
+    }
+
+    bool neverTransition(string)
+    {
+        return false;
+    }
+
+    bool alwaysTransition(string)
+    {
+        return true;
+    }
+
+    template <typename Tick>
+    void measure(const string &name, size_t size, Tick tick)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        for (uint64_t i = 0; i < ticks; i++)
+        {
+            tick();
+        }
+
+        double elapsed = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+
+        cout << name << ": " << elapsed / static_cast<double>(ticks) << " ns/tick, sizeof " << size << endl;
+    }
+
+    const size_t dfaBytes = 64 * 1024 * 1024;
+
+    template <typename Feed>
+    void measureThroughput(const string &name, size_t bytes, Feed feed)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        feed();
+
+        double elapsed = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+
+        cout << name << ": " << static_cast<double>(bytes) / elapsed << " GB/s" << endl;
+    }
+
+    void countAction(void *context, const uint8_t *)
+    {
+        (*static_cast<uint64_t *>(context))++;
+    }
+
+    // Quoted strings with escapes: long runs inside strings are skipped ahead.
+    void buildScanner(StateDfa &dfa)
+    {
+        dfa.addState("outside");
+        dfa.addState("string");
+        dfa.addState("escape");
+        dfa.addTransition("outside", '"', "string");
+        dfa.addTransition("string", '"', "outside", countAction);
+        dfa.addTransition("string", '\\', "escape");
+        dfa.addTransition("escape", 0, 255, "string");
+    }
+
+    // Every byte can change the state, so every byte is a table lookup.
+    void buildWalker(StateDfa &dfa)
+    {
+        const size_t stateCount = 16;
+
+        for (size_t s = 0; s < stateCount; s++)
+        {
+            dfa.addState("s" + to_string(s));
+        }
+
+        for (size_t s = 0; s < stateCount; s++)
+        {
+            for (size_t byte = 0; byte < 256; byte++)
+            {
+                dfa.addTransition("s" + to_string(s), static_cast<uint8_t>(byte), "s" + to_string((s * 7 + byte) % stateCount), byte == 0 ? countAction : nullptr);
+            }
+        }
+    }
+
+    // 10000 states x 500 events, a few events handled per state: every lookup depends on the one before.
+    void measureDispatch(StateDispatchTable &table, StateDispatchTable::Layout layout, const string &name)
+    {
+        table.compile(layout);
+
+        size_t state = 0;
+        size_t event = 0;
+
+        measure(name + " (" + to_string(table.getTableBytes() / 1024) + " KiB)", sizeof(table), [&]() {
+            uint32_t target = table.get(state, event);
+
+            state = target != StateDispatchTable::noTarget ? target : (state + 1) % table.getStateCount();
+            event = (event * 7 + 1) % table.getEventCount();
+        });
+
+        work = work + state;
+    }
+
+    // Eight states with their own functions, instances leaving their state now and then, so the states stay mixed.
+    template <int N>
+    bool fleetState()
+    {
+        work = work + N;
+        return true;
+    }
+
+    uint32_t guardSeed = 1;
+
+    bool sometimes(string)
+    {
+        guardSeed = guardSeed * 1664525u + 1013904223u;
+        return guardSeed >> 28 == 0;
+    }
+
+    void buildFleetStates(StateManager &stateManager)
+    {
+        bool (*functions[])() = {fleetState<0>, fleetState<1>, fleetState<2>, fleetState<3>, fleetState<4>, fleetState<5>, fleetState<6>, fleetState<7>};
+
+        for (int s = 0; s < 8; s++)
+        {
+            stateManager.addState("s" + to_string(s));
+            stateManager.setStateFunction("s" + to_string(s), functions[s]);
+            stateManager.setTransitionToState("s" + to_string(s), sometimes);
+        }
+
+        stateManager.transition("s0");
+    }
+
+    template <typename Round>
+    void measureFleet(const string &name, size_t instanceCount, Round round)
+    {
+        const size_t rounds = 200;
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        for (size_t i = 0; i < rounds; i++)
+        {
+            round();
+        }
+
+        double elapsed = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+
+        cout << name << ": " << elapsed / static_cast<double>(rounds * instanceCount) << " ns/instance tick" << endl;
+    }
+
+    template <typename Manager>
+    void configure(Manager &manager)
+    {
+        manager.addState("idle");
+        manager.addState("busy");
+        manager.setStateFunction("busy", stateFunction);
+        manager.setTransitionToState("idle", neverTransition);
+        manager.transition("busy");
+    }
+}
+
+int main()
+{
+    StateManager stateManager;
+    stateManager.addState("idle");
+    stateManager.addState("busy");
+    stateManager.setStateFunction("busy", stateFunction);
+    stateManager.setTransitionToState("idle", neverTransition);
+    stateManager.transition("busy");
+
+#ifdef STATEMANAGER_INLINE_DISPATCH
+    string stateManagerName = "StateManager (inline dispatch";
+#else
+    string stateManagerName = "StateManager (";
+#endif
+
+#if STATEMANAGER_FEATURES == 0
+    stateManagerName += stateManagerName.back() == '(' ? "no features)" : ", no features)";
+#else
+    stateManagerName += stateManagerName.back() == '(' ? "all features)" : ", all features)";
+#endif
+
+    measure(stateManagerName, sizeof(stateManager), [&]() { stateManager.run(true); });
+
+    // Every tick enters the other state, so entering a state is measured as well.
+    StateManager pingPong;
+    pingPong.addState("ping");
+    pingPong.addState("pong");
+    pingPong.setStateFunction("ping", stateFunction);
+    pingPong.setStateFunction("pong", stateFunction);
+    pingPong.setTransitionToState("ping", alwaysTransition);
+    pingPong.setTransitionToState("pong", alwaysTransition);
+    pingPong.transition("ping");
+
+    measure(stateManagerName + " transitioning every tick", sizeof(pingPong), [&]() { pingPong.run(true); });
+
+    BasicStateManager<> basic;
+    configure(basic);
+
+    measure("BasicStateManager<>", sizeof(basic), [&]() { basic.run(true); });
+
+    BasicStateManager<SingleThreaded, NoInstrumentation, FixedStorage<2>, FunctionPointerCallbacks, uint8_t> fixed;
+    configure(fixed);
+
+    measure("BasicStateManager<FixedStorage<2>, uint8_t>", sizeof(fixed), [&]() { fixed.run(true); });
+
+    BasicStateManager<SingleThreaded, CountingInstrumentation> counting;
+    configure(counting);
+
+    measure("BasicStateManager<CountingInstrumentation>", sizeof(counting), [&]() { counting.run(true); });
+
+    BasicStateManager<MultiThreaded, CountingInstrumentation, DynamicStorage, StdFunctionCallbacks> everything;
+    configure(everything);
+
+    measure("BasicStateManager<MultiThreaded, CountingInstrumentation, StdFunctionCallbacks>", sizeof(everything), [&]() { everything.run(true); });
+
+    vector<uint8_t> text(dfaBytes);
+    uint64_t actionsFired = 0;
+
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        text[i] = i % 4096 == 0 ? '"' : static_cast<uint8_t>('a' + i % 26);
+    }
+
+    StateDfa scanner;
+    buildScanner(scanner);
+    scanner.setActionContext(&actionsFired);
+    scanner.compile();
+
+    measureThroughput("StateDfa (skip-ahead)", text.size(), [&]() { scanner.feed(text.data(), text.size()); });
+
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        text[i] = static_cast<uint8_t>(i * 2654435761u >> 13);
+    }
+
+    StateDfa walker;
+    buildWalker(walker);
+    walker.setActionContext(&actionsFired);
+    walker.compile();
+
+    measureThroughput("StateDfa (table walk)", text.size(), [&]() { walker.feed(text.data(), text.size()); });
+
+    // 16 connections through the same table, one after the other and interleaved.
+    const size_t streamCount = 16;
+    const size_t streamBytes = text.size() / streamCount;
+    vector<StateDfa::Stream> streams(streamCount);
+
+    auto rewind = [&]() {
+        for (size_t i = 0; i < streamCount; i++)
+        {
+            streams[i].data = text.data() + i * streamBytes;
+            streams[i].size = streamBytes;
+            streams[i].context = &actionsFired;
+        }
+    };
+
+    rewind();
+    measureThroughput("StateDfa 16 streams (one at a time)", streamCount * streamBytes, [&]() {
+        for (size_t i = 0; i < streamCount; i++)
+        {
+            walker.feed(&streams[i], 1);
+        }
+    });
+
+    rewind();
+    measureThroughput("StateDfa 16 streams (4 interleaved)", streamCount * streamBytes, [&]() {
+        for (size_t i = 0; i < streamCount; i += 4)
+        {
+            walker.feedInterleaved<4>(&streams[i]);
+        }
+    });
+
+    rewind();
+    measureThroughput("StateDfa 16 streams (8 interleaved)", streamCount * streamBytes, [&]() {
+        for (size_t i = 0; i < streamCount; i += 8)
+        {
+            walker.feedInterleaved<8>(&streams[i]);
+        }
+    });
+
+    rewind();
+    measureThroughput("StateDfa 16 streams (16 interleaved)", streamCount * streamBytes, [&]() { walker.feedInterleaved<16>(streams.data()); });
+
+    StateDispatchTable dispatchTable;
+    dispatchTable.reset(10000, 500);
+
+    for (size_t state = 0; state < 10000; state++)
+    {
+        for (size_t i = 0; i < 4; i++)
+        {
+            dispatchTable.set(state, (state * 31 + i * 97) % 500, static_cast<uint32_t>((state * 2654435761u + i) % 10000));
+        }
+    }
+
+    measureDispatch(dispatchTable, StateDispatchTable::Dense, "StateDispatchTable dense");
+    measureDispatch(dispatchTable, StateDispatchTable::Compressed, "StateDispatchTable compressed");
+
+    const size_t instanceCount = 10000;
+
+    StateManager fleetManager;
+    buildFleetStates(fleetManager);
+
+    StateDefinitionDomain fleetDomain(fleetManager.compile());
+    vector<StateMachine *> machines;
+    StateFleet fleet(fleetDomain);
+    vector<uint64_t> contexts(instanceCount);
+
+    for (size_t i = 0; i < instanceCount; i++)
+    {
+        machines.push_back(new StateMachine(fleetDomain));
+        fleet.addInstance(&contexts[i]);
+    }
+
+    // Mix the states up before measuring.
+    for (size_t i = 0; i < 50; i++)
+    {
+        fleet.run(true);
+
+        for (auto machine : machines)
+        {
+            machine->run(true);
+        }
+    }
+
+    measureFleet("StateMachine fleet (index order)", instanceCount, [&]() {
+        for (auto machine : machines)
+        {
+            machine->run(true);
+        }
+    });
+
+    measureFleet("StateFleet (bucketed by state)", instanceCount, [&]() { fleet.run(true); });
+
+    for (auto machine : machines)
+    {
+        delete machine;
+    }
+}
@@ -0,0 +1,23 @@
+#include <cstddef>
+
+#include "StateArena.hpp"
+
+using namespace std;
+
+StateArena::StateArena()
+{
+    bufferCapacity = 0;
+    used = 0;
+}
+
+void StateArena::reserve(size_t capacity)
+{
+    if (capacity <= bufferCapacity)
+    {
+        return;
+    }
+
+    buffer.reset(new unsigned char[capacity]);
+    bufferCapacity = capacity;
+    used = 0;
+}
@@ -0,0 +1,88 @@
+/**
+ * @brief A bump allocator for storage that lives as long as a state is active.
+ * @author Honzik Schenk
+ *
+ * StateArena hands out memory from one preallocated buffer by moving an offset
+ * forward, and frees everything at once by moving it back to the start. A
+ * state manager keeps one arena: the local storage of a state (and any scratch
+ * memory its functions ask for) is allocated when the state is entered and
+ * released in bulk when it is left, so ticks never allocate.
+ */
+
+#ifndef STATEARENA_HPP
+#define STATEARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+using namespace std;
+
+class StateArena
+{
+public:
+    StateArena();
+
+    /**
+     * @brief Make room for at least a number of bytes.
+     * @param capacity The number of bytes the arena has to hold.
+     *
+     * @warning Growing the arena releases everything allocated from it.
+     */
+    void reserve(size_t capacity);
+
+    /**
+     * @brief Allocate memory from the arena.
+     * @param size The number of bytes to allocate.
+     * @param alignment The alignment of the memory (a power of two).
+     * @return The memory, or nullptr if the arena is full.
+     */
+    void *allocate(size_t size, size_t alignment)
+    {
+        uintptr_t start = reinterpret_cast<uintptr_t>(buffer.get()) + used;
+        size_t padding = static_cast<size_t>((alignment - start % alignment) % alignment);
+
+        if (size + padding > bufferCapacity - used)
+        {
+            return nullptr;
+        }
+
+        used += padding + size;
+
+        return reinterpret_cast<void *>(start + padding);
+    }
+
+    /**
+     * @brief Release everything allocated from the arena.
+     */
+    void reset()
+    {
+        used = 0;
+    }
+
+    /**
+     * @brief Get the number of bytes the arena can hold.
+     */
+    size_t capacity() const
+    {
+        return bufferCapacity;
+    }
+
+    /**
+     * @brief Get the number of bytes allocated (including alignment padding).
+     */
+    size_t size() const
+    {
+        return used;
+    }
+
+private:
+    unique_ptr<unsigned char[]> buffer;
+    size_t bufferCapacity;
+    size_t used;
+
+    StateArena(const StateArena &) = delete;
+    StateArena &operator=(const StateArena &) = delete;
+};
+
+#endif // STATEARENA_HPP
@@ -0,0 +1,128 @@
+#include <string>
+#include <vector>
+
+#include "StateBlackboard.hpp"
+#include "StateManager.hpp"
+
+using namespace std;
+
+const StateBlackboard::InputId StateBlackboard::invalidInput;
+
+StateBlackboard::StateBlackboard()
+{
+    inputs = vector<Input>();
+}
+
+StateBlackboard::~StateBlackboard()
+{
+    // Detaching a state manager unsubscribes it from every input, so keep going until no subscribers are left.
+    for (auto &input : inputs)
+    {
+        while (!input.subscribers.empty())
+        {
+            input.subscribers.back().stateManager->detachBlackboard(this);
+        }
+    }
+}
+
+StateBlackboard::InputId StateBlackboard::addInput(string inputName, bool value)
+{
+    InputId existing = getInputId(inputName);
+
+    if (existing != invalidInput)
+    {
+        return existing;
+    }
+
+    Input input;
+    input.inputName = inputName;
+    input.value = value;
+
+    inputs.push_back(input);
+
+    return inputs.size() - 1;
+}
+
+StateBlackboard::InputId StateBlackboard::getInputId(string inputName)
+{
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        if (inputs[i].inputName == inputName)
+        {
+            return i;
+        }
+    }
+
+    return invalidInput;
+}
+
+bool StateBlackboard::setInput(string inputName, bool value)
+{
+    return setInput(getInputId(inputName), value);
+}
+
+bool StateBlackboard::setInput(InputId input, bool value)
+{
+    if (input >= inputs.size())
+    {
+        return false;
+    }
+
+    bool wasSet = inputs[input].value;
+
+    inputs[input].value = value;
+
+    if (!wasSet && value)
+    {
+        for (auto &subscriber : inputs[input].subscribers)
+        {
+            subscriber.stateManager->notifyEdgeTrigger(subscriber.trigger);
+        }
+    }
+
+    return true;
+}
+
+bool StateBlackboard::getInput(string inputName)
+{
+    InputId input = getInputId(inputName);
+
+    return input != invalidInput && inputs[input].value;
+}
+
+void StateBlackboard::subscribe(InputId input, StateManager *stateManager, size_t trigger)
+{
+    Subscriber subscriber;
+    subscriber.stateManager = stateManager;
+    subscriber.trigger = trigger;
+
+    inputs[input].subscribers.push_back(subscriber);
+}
+
+void StateBlackboard::unsubscribe(StateManager *stateManager)
+{
+    for (auto &input : inputs)
+    {
+        for (size_t i = input.subscribers.size(); i > 0; i--)
+        {
+            if (input.subscribers[i - 1].stateManager == stateManager)
+            {
+                input.subscribers.erase(input.subscribers.begin() + (i - 1));
+            }
+        }
+    }
+}
+
+void StateBlackboard::unsubscribe(StateManager *stateManager, size_t trigger)
+{
+    for (auto &input : inputs)
+    {
+        for (size_t i = input.subscribers.size(); i > 0; i--)
+        {
+            if (input.subscribers[i - 1].stateManager == stateManager && input.subscribers[i - 1].trigger == trigger)
+            {
+                input.subscribers.erase(input.subscribers.begin() + (i - 1));
+            }
+        }
+    }
+}
@@ -0,0 +1,105 @@
+/**
+ * @brief Named boolean inputs shared between state managers.
+ * @author Honzik Schenk
+ *
+ * StateBlackboard holds inputs such as "button pressed" that state managers
+ * can subscribe to with edge-triggered transitions. Every input keeps its own
+ * list of subscribers, so setting an input only notifies the state managers
+ * that actually wait for its rising edge instead of every machine polling it.
+ */
+
+#ifndef STATEBLACKBOARD_HPP
+#define STATEBLACKBOARD_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class StateManager;
+
+class StateBlackboard
+{
+public:
+    typedef size_t InputId;
+
+    /**
+     * @brief Returned when an input is not found.
+     */
+    static const InputId invalidInput = static_cast<InputId>(-1);
+
+    StateBlackboard();
+
+    ~StateBlackboard();
+
+    /**
+     * @brief Add an input to the blackboard.
+     * @param inputName The name of the new input.
+     * @param value The initial value of the input.
+     * @return The id of the input (or of the existing input with the same name).
+     */
+    InputId addInput(string inputName, bool value = false);
+
+    /**
+     * @brief Get the id of an input, for setting it without looking up its name.
+     * @param inputName The name of the input.
+     * @return The id of the input, or invalidInput if not found.
+     */
+    InputId getInputId(string inputName);
+
+    /**
+     * @brief Set the value of an input.
+     * @param inputName The name of the input.
+     * @param value The new value.
+     * @return True if the input was found and set, false if not found.
+     *
+     * @note A false to true change notifies every state manager with an edge-triggered transition on the input.
+     */
+    bool setInput(string inputName, bool value);
+
+    /**
+     * @brief Set the value of an input by its id.
+     * @param input The id of the input.
+     * @param value The new value.
+     * @return True if the input was found and set, false if not found.
+     */
+    bool setInput(InputId input, bool value);
+
+    /**
+     * @brief Get the value of an input.
+     * @param inputName The name of the input.
+     * @return The value of the input, or false if not found.
+     */
+    bool getInput(string inputName);
+
+private:
+    friend class StateManager;
+
+    struct Subscriber
+    {
+        StateManager *stateManager;
+        size_t trigger;
+    };
+
+    struct Input
+    {
+        string inputName;
+        bool value;
+        vector<Subscriber> subscribers;
+    };
+
+    vector<Input> inputs;
+
+    void subscribe(InputId input, StateManager *stateManager, size_t trigger);
+
+    void unsubscribe(StateManager *stateManager);
+
+    // Only the subscription of one edge-triggered transition.
+    void unsubscribe(StateManager *stateManager, size_t trigger);
+
+    StateBlackboard(const StateBlackboard &) = delete;
+    StateBlackboard &operator=(const StateBlackboard &) = delete;
+};
+
+#endif // STATEBLACKBOARD_HPP
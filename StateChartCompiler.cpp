@@ -0,0 +1,678 @@
+// NOTE: This tool turns a statechart definition file into a C++ header for the StateManager library.
+// To build it with gcc, use the following command: g++ -std=c++11 -o StateChartCompiler StateChartCompiler.cpp
+// Usage: ./StateChartCompiler Example.chart Example.hpp
+//
+// A definition file has one directive per line (everything after # is a comment):
+//   machine <Name>                                   the namespace of the generated header
+//   state <Name> [parent <State>] [guard <function>] [action <function>]
+//   initial <Composite> <Child>                      the child entered when the composite state is entered
+//   history <Composite> shallow|deep
+//   transition <From> -> <To>                        a transition the guard of <To> may take
+//   event <From> <Event> -> <To>                     a transition taken when <Event> is dispatched in <From>
+//   defer <State> <Event>
+// States may be referenced before they are declared. Names must be C++ identifiers that are neither keywords nor
+// names the generated header uses itself (ex: noState, configure).
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    struct ChartState
+    {
+        // The line the state is declared on, where errors about the state are reported.
+        size_t line;
+
+        string name;
+        string parent;
+        string guard;
+        string action;
+        string initial;
+        string history;
+    };
+
+    // An initial or history directive, applied once every state is declared.
+    struct ChartSetting
+    {
+        size_t line;
+        string directive;
+        string state;
+        string value;
+    };
+
+    struct ChartEvent
+    {
+        size_t line;
+        string from;
+        string event;
+        string to;
+    };
+
+    struct Chart
+    {
+        string machine;
+        vector<ChartState> states;
+        map<string, size_t> stateIndex;
+        vector<string> events;
+        map<string, size_t> eventIndex;
+
+        // The first line using every event.
+        vector<size_t> eventLine;
+        vector<pair<string, string>> transitions;
+        vector<ChartEvent> eventTransitions;
+        vector<pair<string, string>> defers;
+    };
+
+    bool isIdentifier(const string &word)
+    {
+        if (word.empty() || !(isalpha(static_cast<unsigned char>(word[0])) || word[0] == '_'))
+        {
+            return false;
+        }
+
+        for (char c : word)
+        {
+            if (!(isalnum(static_cast<unsigned char>(c)) || c == '_'))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Names the generated header cannot use: C++ keywords and the names it declares or uses itself.
+    bool isReserved(const string &word)
+    {
+        static const char *const reserved[] = {
+            "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break", "case", "catch",
+            "char", "char16_t", "char32_t", "class", "compl", "const", "const_cast", "constexpr", "continue", "decltype",
+            "default", "delete", "do", "double", "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false",
+            "float", "for", "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept",
+            "not", "not_eq", "nullptr", "operator", "or", "or_eq", "private", "protected", "public", "register",
+            "reinterpret_cast", "return", "short", "signed", "sizeof", "static", "static_assert", "static_cast", "struct",
+            "switch", "template", "this", "thread_local", "throw", "true", "try", "typedef", "typeid", "typename", "union",
+            "unsigned", "using", "virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq",
+            "StateId", "EventId", "Transition", "stateCount", "eventCount", "transitionCount", "noState", "stateNames",
+            "parentOf", "initialOf", "historyOf", "guardOf", "actionOf", "transitions", "eventTable", "onEvent", "Deferral",
+            "deferrals", "deferralCount", "configure", "StateManager", "std", "size_t", "uint16_t"};
+
+        for (const char *name : reserved)
+        {
+            if (word == name)
+            {
+                return true;
+            }
+        }
+
+        // Identifiers with a double underscore or starting with an underscore and a capital are reserved too.
+        return word.find("__") != string::npos || (word.size() > 1 && word[0] == '_' && isupper(static_cast<unsigned char>(word[1])));
+    }
+
+    bool fail(const string &path, size_t line, const string &message)
+    {
+        cerr << path << ":" << line << ": " << message << endl;
+
+        return false;
+    }
+
+    size_t addEvent(Chart &chart, const string &event, size_t line)
+    {
+        auto found = chart.eventIndex.find(event);
+
+        if (found != chart.eventIndex.end())
+        {
+            return found->second;
+        }
+
+        chart.eventIndex[event] = chart.events.size();
+        chart.events.push_back(event);
+        chart.eventLine.push_back(line);
+
+        return chart.events.size() - 1;
+    }
+
+    bool parse(const string &path, istream &input, Chart &chart)
+    {
+        // States may be referenced before they are declared, so references are checked once the whole file is read.
+        vector<pair<size_t, string>> references;
+        vector<ChartSetting> settings;
+        string text;
+        size_t line = 0;
+
+        while (getline(input, text))
+        {
+            line++;
+
+            size_t comment = text.find('#');
+
+            if (comment != string::npos)
+            {
+                text.erase(comment);
+            }
+
+            istringstream stream(text);
+            vector<string> words;
+            string word;
+
+            while (stream >> word)
+            {
+                words.push_back(word);
+            }
+
+            if (words.empty())
+            {
+                continue;
+            }
+
+            for (size_t i = 1; i < words.size(); i++)
+            {
+                if (words[i] != "->" && !isIdentifier(words[i]))
+                {
+                    return fail(path, line, "'" + words[i] + "' is not a valid name");
+                }
+
+                if (isReserved(words[i]))
+                {
+                    return fail(path, line, "'" + words[i] + "' is reserved in the generated header");
+                }
+            }
+
+            const string &directive = words[0];
+
+            if (directive == "machine" && words.size() == 2)
+            {
+                chart.machine = words[1];
+            }
+            else if (directive == "state" && words.size() >= 2 && words.size() % 2 == 0)
+            {
+                if (chart.stateIndex.count(words[1]))
+                {
+                    return fail(path, line, "state '" + words[1] + "' is declared twice");
+                }
+
+                // State ids are 16 bits wide in the generated header, and 0xFFFF is noState.
+                if (chart.states.size() + 1 >= 0xFFFF)
+                {
+                    return fail(path, line, "too many states (the generated ids are 16 bits wide)");
+                }
+
+                ChartState state;
+                state.line = line;
+                state.name = words[1];
+
+                for (size_t i = 2; i < words.size(); i += 2)
+                {
+                    if (words[i] == "parent")
+                    {
+                        state.parent = words[i + 1];
+                        references.push_back(make_pair(line, state.parent));
+                    }
+                    else if (words[i] == "guard")
+                    {
+                        state.guard = words[i + 1];
+                    }
+                    else if (words[i] == "action")
+                    {
+                        state.action = words[i + 1];
+                    }
+                    else
+                    {
+                        return fail(path, line, "unknown state attribute '" + words[i] + "'");
+                    }
+                }
+
+                chart.stateIndex[state.name] = chart.states.size();
+                chart.states.push_back(state);
+            }
+            else if ((directive == "initial" || directive == "history") && words.size() == 3)
+            {
+                if (directive == "history" && words[2] != "shallow" && words[2] != "deep")
+                {
+                    return fail(path, line, "history must be 'shallow' or 'deep'");
+                }
+
+                ChartSetting setting;
+                setting.line = line;
+                setting.directive = directive;
+                setting.state = words[1];
+                setting.value = words[2];
+
+                settings.push_back(setting);
+                references.push_back(make_pair(line, words[1]));
+
+                if (directive == "initial")
+                {
+                    references.push_back(make_pair(line, words[2]));
+                }
+            }
+            else if (directive == "transition" && words.size() == 4 && words[2] == "->")
+            {
+                chart.transitions.push_back(make_pair(words[1], words[3]));
+                references.push_back(make_pair(line, words[1]));
+                references.push_back(make_pair(line, words[3]));
+            }
+            else if (directive == "event" && words.size() == 5 && words[3] == "->")
+            {
+                ChartEvent event;
+                event.line = line;
+                event.from = words[1];
+                event.event = words[2];
+                event.to = words[4];
+
+                addEvent(chart, event.event, line);
+                chart.eventTransitions.push_back(event);
+                references.push_back(make_pair(line, event.from));
+                references.push_back(make_pair(line, event.to));
+            }
+            else if (directive == "defer" && words.size() == 3)
+            {
+                addEvent(chart, words[2], line);
+                chart.defers.push_back(make_pair(words[1], words[2]));
+                references.push_back(make_pair(line, words[1]));
+            }
+            else
+            {
+                return fail(path, line, "cannot parse '" + directive + "' directive");
+            }
+        }
+
+        if (!isIdentifier(chart.machine))
+        {
+            return fail(path, line, "missing 'machine <Name>' directive");
+        }
+
+        for (auto &reference : references)
+        {
+            if (!chart.stateIndex.count(reference.second))
+            {
+                return fail(path, reference.first, "unknown state '" + reference.second + "'");
+            }
+        }
+
+        for (auto &setting : settings)
+        {
+            ChartState &state = chart.states[chart.stateIndex.at(setting.state)];
+
+            if (setting.directive == "history")
+            {
+                state.history = setting.value;
+            }
+            else if (chart.states[chart.stateIndex.at(setting.value)].parent != state.name)
+            {
+                return fail(path, setting.line, "'" + setting.value + "' is not a child of '" + state.name + "'");
+            }
+            else
+            {
+                state.initial = setting.value;
+            }
+        }
+
+        for (auto &state : chart.states)
+        {
+            // A parent chain longer than the number of states must loop.
+            string parent = state.parent;
+
+            for (size_t depth = 0; !parent.empty(); depth++)
+            {
+                if (depth == chart.states.size())
+                {
+                    return fail(path, state.line, "state '" + state.name + "' is its own ancestor");
+                }
+
+                parent = chart.states[chart.stateIndex.at(parent)].parent;
+            }
+        }
+
+        for (size_t i = 0; i < chart.events.size(); i++)
+        {
+            if (chart.stateIndex.count(chart.events[i]))
+            {
+                return fail(path, chart.eventLine[i], "'" + chart.events[i] + "' is both a state and an event");
+            }
+        }
+
+        for (auto &state : chart.states)
+        {
+            // Guards and actions are declared in the namespace of the enums, so they cannot share a name with them.
+            for (const string *function : {&state.guard, &state.action})
+            {
+                if (chart.stateIndex.count(*function) || chart.eventIndex.count(*function))
+                {
+                    return fail(path, state.line, "function '" + *function + "' has the name of a state or an event");
+                }
+            }
+        }
+
+        for (auto &event : chart.eventTransitions)
+        {
+            for (auto &other : chart.eventTransitions)
+            {
+                if (&other != &event && other.from == event.from && other.event == event.event && other.to != event.to)
+                {
+                    return fail(path, other.line, "event '" + event.event + "' has two targets from state '" + event.from + "'");
+                }
+            }
+        }
+
+        return true;
+    }
+
+    string upper(string text)
+    {
+        for (char &c : text)
+        {
+            c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+        }
+
+        return text;
+    }
+
+    void emit(const Chart &chart, const string &source, ostream &out)
+    {
+        const string guardName = upper(chart.machine) + "_HPP";
+        const size_t stateCount = chart.states.size();
+        const size_t eventCount = chart.events.size();
+
+        out << "/**\n";
+        out << " * @brief The " << chart.machine << " state machine, generated from " << source << " by StateChartCompiler.\n";
+        out << " *\n";
+        out << " * Do not edit this file, edit " << source << " and generate it again.\n";
+        out << " */\n\n";
+        out << "#ifndef " << guardName << "\n";
+        out << "#define " << guardName << "\n\n";
+        out << "#include <cstddef>\n";
+        out << "#include <cstdint>\n";
+        out << "#include <string>\n\n";
+        out << "#include \"StateManager.hpp\"\n\n";
+        out << "namespace " << chart.machine << "\n{\n";
+
+        out << "    enum StateId : uint16_t\n    {\n";
+
+        for (auto &state : chart.states)
+        {
+            out << "        " << state.name << ",\n";
+        }
+
+        out << "    };\n\n";
+        out << "    const size_t stateCount = " << stateCount << ";\n\n";
+        out << "    // Returned by the tables below where there is no state.\n";
+        out << "    const uint16_t noState = 0xFFFF;\n\n";
+
+        if (eventCount != 0)
+        {
+            out << "    enum EventId : unsigned\n    {\n";
+
+            for (auto &event : chart.events)
+            {
+                out << "        " << event << ",\n";
+            }
+
+            out << "    };\n\n";
+        }
+
+        out << "    const size_t eventCount = " << eventCount << ";\n\n";
+
+        // Every function is declared once, even if several states share it.
+        map<string, bool> declared;
+        bool anyFunction = false;
+
+        for (auto &state : chart.states)
+        {
+            anyFunction = anyFunction || !state.guard.empty() || !state.action.empty();
+        }
+
+        if (anyFunction)
+        {
+            out << "    // Guards and actions, defined by the application.\n";
+
+            for (auto &state : chart.states)
+            {
+                if (!state.guard.empty() && !declared[state.guard])
+                {
+                    out << "    bool " << state.guard << "(std::string activeState);\n";
+                    declared[state.guard] = true;
+                }
+
+                if (!state.action.empty() && !declared[state.action])
+                {
+                    out << "    bool " << state.action << "();\n";
+                    declared[state.action] = true;
+                }
+            }
+
+            out << "\n";
+        }
+
+        // One entry per state in every table below, indexed by StateId.
+        out << "    constexpr const char *stateNames[] = {\n";
+
+        for (auto &state : chart.states)
+        {
+            out << "        \"" << state.name << "\",\n";
+        }
+
+        out << "    };\n\n";
+
+        out << "    constexpr uint16_t parentOf[] = {\n";
+
+        for (auto &state : chart.states)
+        {
+            out << "        " << (state.parent.empty() ? "noState" : state.parent) << ",\n";
+        }
+
+        out << "    };\n\n";
+
+        out << "    constexpr uint16_t initialOf[] = {\n";
+
+        for (auto &state : chart.states)
+        {
+            out << "        " << (state.initial.empty() ? "noState" : state.initial) << ",\n";
+        }
+
+        out << "    };\n\n";
+
+        out << "    constexpr StateManager::HistoryType historyOf[] = {\n";
+
+        for (auto &state : chart.states)
+        {
+            out << "        StateManager::" << (state.history.empty() ? "NoHistory" : state.history == "deep" ? "DeepHistory" : "ShallowHistory") << ",\n";
+        }
+
+        out << "    };\n\n";
+
+        out << "    constexpr bool (*guardOf[])(std::string activeState) = {\n";
+
+        for (auto &state : chart.states)
+        {
+            out << "        " << (state.guard.empty() ? "nullptr" : state.guard) << ",\n";
+        }
+
+        out << "    };\n\n";
+
+        out << "    constexpr bool (*actionOf[])() = {\n";
+
+        for (auto &state : chart.states)
+        {
+            out << "        " << (state.action.empty() ? "nullptr" : state.action) << ",\n";
+        }
+
+        out << "    };\n\n";
+
+        out << "    struct Transition\n    {\n        StateId from;\n        StateId to;\n    };\n\n";
+
+        if (!chart.transitions.empty())
+        {
+            out << "    constexpr Transition transitions[] = {\n";
+
+            for (auto &transition : chart.transitions)
+            {
+                out << "        {" << transition.first << ", " << transition.second << "},\n";
+            }
+
+            out << "    };\n\n";
+        }
+
+        out << "    const size_t transitionCount = " << chart.transitions.size() << ";\n\n";
+
+        if (eventCount != 0)
+        {
+            // Dense table, one row per state: dispatching an event is a single load the compiler can fold when both ids are known.
+            vector<string> table(stateCount * eventCount, "noState");
+
+            for (auto &event : chart.eventTransitions)
+            {
+                table[chart.stateIndex.at(event.from) * eventCount + chart.eventIndex.at(event.event)] = event.to;
+            }
+
+            out << "    constexpr uint16_t eventTable[" << stateCount << "][" << eventCount << "] = {\n";
+
+            for (size_t s = 0; s < stateCount; s++)
+            {
+                out << "        {";
+
+                for (size_t e = 0; e < eventCount; e++)
+                {
+                    out << (e == 0 ? "" : ", ") << table[s * eventCount + e];
+                }
+
+                out << "},\n";
+            }
+
+            out << "    };\n\n";
+
+            out << "    /**\n";
+            out << "     * @brief Get the state an event leads to, looking at the composite states of the state too.\n";
+            out << "     * @return The target state, or noState if neither the state nor its composite states handle the event.\n";
+            out << "     */\n";
+            out << "    constexpr uint16_t onEvent(uint16_t state, EventId event)\n    {\n";
+            out << "        return state == noState ? noState : eventTable[state][event] != noState ? eventTable[state][event] : onEvent(parentOf[state], event);\n";
+            out << "    }\n\n";
+
+            out << "    struct Deferral\n    {\n        StateId state;\n        EventId event;\n    };\n\n";
+
+            if (!chart.defers.empty())
+            {
+                out << "    constexpr Deferral deferrals[] = {\n";
+
+                for (auto &defer : chart.defers)
+                {
+                    out << "        {" << defer.first << ", " << defer.second << "},\n";
+                }
+
+                out << "    };\n\n";
+            }
+
+            out << "    const size_t deferralCount = " << chart.defers.size() << ";\n\n";
+        }
+
+        out << "    /**\n";
+        out << "     * @brief Add the states and transitions of the tables above to a state manager.\n";
+        out << "     * @param stateManager The state manager to configure.\n";
+        out << "     * @return True if the state manager was configured successfully, false if a call failed (ex: a state already exists).\n";
+        out << "     */\n";
+        out << "    inline bool configure(StateManager &stateManager)\n    {\n";
+        out << "        bool configured = true;\n\n";
+        out << "        for (size_t s = 0; s < stateCount; s++)\n        {\n";
+        out << "            configured = stateManager.addState(stateNames[s]) && configured;\n";
+        out << "            configured = (actionOf[s] == nullptr || stateManager.setStateFunction(stateNames[s], actionOf[s])) && configured;\n";
+        out << "            configured = (guardOf[s] == nullptr || stateManager.setTransitionToState(stateNames[s], guardOf[s])) && configured;\n";
+        out << "        }\n\n";
+        out << "        for (size_t s = 0; s < stateCount; s++)\n        {\n";
+        out << "            configured = (parentOf[s] == noState || stateManager.setParentState(stateNames[s], stateNames[parentOf[s]])) && configured;\n";
+        out << "        }\n\n";
+        out << "        for (size_t s = 0; s < stateCount; s++)\n        {\n";
+        out << "            configured = (initialOf[s] == noState || stateManager.setInitialState(stateNames[s], stateNames[initialOf[s]])) && configured;\n";
+        out << "            configured = (historyOf[s] == StateManager::NoHistory || stateManager.setHistory(stateNames[s], historyOf[s])) && configured;\n";
+        out << "        }\n\n";
+
+        if (!chart.transitions.empty())
+        {
+            out << "        for (size_t t = 0; t < transitionCount; t++)\n        {\n";
+            out << "            configured = stateManager.addTransition(stateNames[transitions[t].from], stateNames[transitions[t].to]) && configured;\n";
+            out << "        }\n\n";
+        }
+
+        if (eventCount != 0)
+        {
+            out << "        for (size_t s = 0; s < stateCount; s++)\n        {\n";
+            out << "            for (unsigned e = 0; e < eventCount; e++)\n            {\n";
+            out << "                configured = (eventTable[s][e] == noState || stateManager.setEventTransition(stateNames[s], e, stateNames[eventTable[s][e]])) && configured;\n";
+            out << "            }\n";
+            out << "        }\n\n";
+
+            if (!chart.defers.empty())
+            {
+                out << "        for (size_t d = 0; d < deferralCount; d++)\n        {\n";
+                out << "            configured = stateManager.deferEvent(stateNames[deferrals[d].state], deferrals[d].event) && configured;\n";
+                out << "        }\n\n";
+            }
+        }
+
+        out << "        stateManager.finalize();\n\n";
+        out << "        return configured;\n";
+        out << "    }\n";
+        out << "}\n\n";
+        out << "#endif // " << guardName << "\n";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        cerr << "Usage: " << argv[0] << " <definition file> <output header>" << endl;
+
+        return 2;
+    }
+
+    ifstream input(argv[1]);
+
+    if (!input)
+    {
+        cerr << "Cannot open " << argv[1] << endl;
+
+        return 1;
+    }
+
+    Chart chart;
+
+    if (!parse(argv[1], input, chart))
+    {
+        return 1;
+    }
+
+    string source = argv[1];
+    size_t slash = source.find_last_of("/\\");
+
+    if (slash != string::npos)
+    {
+        source.erase(0, slash + 1);
+    }
+
+    // Write to a temporary file first, so a failed run never leaves a half-written header behind.
+    string temporary = string(argv[2]) + ".tmp";
+    ofstream output(temporary.c_str());
+
+    emit(chart, source, output);
+    output.close();
+
+    if (!output || rename(temporary.c_str(), argv[2]) != 0)
+    {
+        cerr << "Cannot write " << argv[2] << endl;
+        remove(temporary.c_str());
+
+        return 1;
+    }
+
+    return 0;
+}
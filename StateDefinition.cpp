@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "StateDefinition.hpp"
+#include "StateManager.hpp"
+
+using namespace std;
+
+const size_t StateDefinition::noState;
+
+StateDefinition::StateDefinition()
+{
+    initialState = noState;
+    compositeCount = 0;
+    generation = 0;
+    mapping = nullptr;
+}
+
+size_t StateDefinition::getStateIndex(const string &stateName) const
+{
+    unordered_map<string, size_t>::const_iterator found = indexByName.find(stateName);
+
+    return found == indexByName.end() ? noState : found->second;
+}
+
+bool StateDefinition::canEnterFrom(size_t to, size_t from) const
+{
+    if (!states[to].restricted)
+    {
+        return true;
+    }
+
+    return binary_search(sources.begin() + sourceStart[to], sources.begin() + sourceStart[to + 1], from);
+}
+
+bool StateDefinition::isWithin(size_t state, size_t ancestor) const
+{
+    for (; state < states.size(); state = states[state].parent)
+    {
+        if (state == ancestor)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+size_t StateDefinition::enter(size_t state, size_t activeState, size_t *lastChild, size_t *lastLeaf) const
+{
+    // Entering a composite state enters one of its leaf states instead.
+    size_t leaf = state;
+
+    while (states[leaf].initialChild != noState)
+    {
+        const State &composite = states[leaf];
+
+        if (composite.history == StateManager::DeepHistory && lastLeaf[composite.composite] != noState)
+        {
+            leaf = lastLeaf[composite.composite];
+            break;
+        }
+
+        leaf = composite.history == StateManager::ShallowHistory && lastChild[composite.composite] != noState ? lastChild[composite.composite] : composite.initialChild;
+    }
+
+    if (activeState != noState)
+    {
+        size_t child = activeState;
+
+        for (size_t parent = states[activeState].parent; parent != noState; parent = states[parent].parent)
+        {
+            size_t composite = states[parent].composite;
+
+            lastChild[composite] = child;
+            lastLeaf[composite] = activeState;
+
+            child = parent;
+        }
+    }
+
+    return leaf;
+}
+
+size_t StateDefinition::eventTarget(size_t state, unsigned event) const
+{
+    if (state >= states.size())
+    {
+        return noState;
+    }
+
+    vector<unsigned>::const_iterator found = lower_bound(events.begin(), events.end(), event);
+
+    if (found == events.end() || *found != event)
+    {
+        return noState;
+    }
+
+    uint32_t target = eventTable.get(state, static_cast<size_t>(found - events.begin()));
+
+    return target != StateDispatchTable::noTarget ? target : noState;
+}
+
+size_t StateDefinition::mapByName(const StateDefinition &from, size_t state, const StateDefinition &to)
+{
+    size_t mapped = state < from.size() ? to.getStateIndex(from.getState(state).stateName) : noState;
+
+    return mapped != noState ? mapped : to.getInitialState();
+}
@@ -0,0 +1,199 @@
+/**
+ * @brief An immutable, compiled state machine definition.
+ * @author Honzik Schenk
+ *
+ * StateDefinition is a snapshot of the states and transitions of a state
+ * manager, compiled into flat tables (states by dense index, the allowed
+ * sources of every state, and a state x event table with the events of
+ * composite states already folded into their children, compressed when it is
+ * sparse). Once compiled it is
+ * never changed, so any number of StateMachine instances on any number of
+ * threads can run from the same definition, and a new definition can be
+ * published while they run (see StateDefinitionDomain).
+ */
+
+#ifndef STATEDEFINITION_HPP
+#define STATEDEFINITION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "StateDispatchTable.hpp"
+
+using namespace std;
+
+class StateDefinition
+{
+public:
+    /**
+     * @brief Returned where there is no state.
+     */
+    static const size_t noState = static_cast<size_t>(-1);
+
+    /**
+     * @brief Maps the active state of a running machine to a state of a newly published definition.
+     * @param from The definition the machine was running.
+     * @param state The active state in from (noState if no state was entered yet).
+     * @param to The new definition.
+     * @return The state to continue in, or noState.
+     */
+    typedef size_t (*StateMapping)(const StateDefinition &from, size_t state, const StateDefinition &to);
+
+    struct State
+    {
+        string stateName;
+
+        bool (*stateFunction)();
+        bool (*transitionToState)(string activeState);
+
+        size_t parent;
+        size_t initialChild;
+
+        // The index of the state among the composite states (noState if it has no children), for per-instance history.
+        size_t composite;
+
+        // A StateManager::HistoryType.
+        int history;
+
+        // True if the state can only be transitioned to from its declared sources.
+        bool restricted;
+    };
+
+    struct GlobalTransition
+    {
+        size_t toState;
+        bool (*transitionToState)(string activeState);
+    };
+
+    /**
+     * @brief Get the number of states.
+     */
+    size_t size() const
+    {
+        return states.size();
+    }
+
+    /**
+     * @brief Get a state by its index (0 to size() - 1).
+     */
+    const State &getState(size_t state) const
+    {
+        return states[state];
+    }
+
+    /**
+     * @brief Get the number of composite states.
+     */
+    size_t getCompositeCount() const
+    {
+        return compositeCount;
+    }
+
+    /**
+     * @brief Get the index of a state.
+     * @param stateName The name of the state.
+     * @return The index of the state, or noState if it was not found.
+     */
+    size_t getStateIndex(const string &stateName) const;
+
+    /**
+     * @brief Get the state new machines start in (the active state of the state manager it was compiled from).
+     * @return The index of the state, or noState if no state was active.
+     */
+    size_t getInitialState() const
+    {
+        return initialState;
+    }
+
+    /**
+     * @brief Check if the transition function of a state may be asked while another state is active.
+     * @param to The state to transition to.
+     * @param from The active state.
+     */
+    bool canEnterFrom(size_t to, size_t from) const;
+
+    /**
+     * @brief Check if a state is another state or one of its descendants.
+     * @param state The state to check (ex: the active state).
+     * @param ancestor The state it may be in.
+     */
+    bool isWithin(size_t state, size_t ancestor) const;
+
+    /**
+     * @brief Find the state entered when transitioning to a state, and record the history of the composite states left.
+     * @param state The state to transition to.
+     * @param activeState The active state of the instance (noState if no state is active).
+     * @param lastChild The last active child of every composite state of the instance (getCompositeCount() entries).
+     * @param lastLeaf The last active leaf state of every composite state of the instance (getCompositeCount() entries).
+     * @return The leaf state to make active (composite states enter one of their children).
+     */
+    size_t enter(size_t state, size_t activeState, size_t *lastChild, size_t *lastLeaf) const;
+
+    /**
+     * @brief Get the state an event leads to.
+     * @param state The active state.
+     * @param event The id of the event.
+     * @return The state to transition to (the composite states of the active state included), or noState.
+     */
+    size_t eventTarget(size_t state, unsigned event) const;
+
+    /**
+     * @brief Get the state x event table, to see its layout and size.
+     */
+    const StateDispatchTable &getEventTable() const
+    {
+        return eventTable;
+    }
+
+    /**
+     * @brief Get the global transitions, sorted by descending priority.
+     */
+    const vector<GlobalTransition> &getGlobalTransitions() const
+    {
+        return globalTransitions;
+    }
+
+    /**
+     * @brief Get the generation the definition was published as (0 until it is published).
+     */
+    uint64_t getGeneration() const
+    {
+        return generation;
+    }
+
+    /**
+     * @brief The default state mapping: the state with the same name, or the initial state of the new definition.
+     */
+    static size_t mapByName(const StateDefinition &from, size_t state, const StateDefinition &to);
+
+private:
+    friend class StateManager;
+    friend class StateDefinitionDomain;
+    friend class StateFleet;
+    friend class StateMachine;
+
+    StateDefinition();
+
+    vector<State> states;
+    unordered_map<string, size_t> indexByName;
+    size_t initialState;
+    size_t compositeCount;
+
+    // The declared sources of every restricted state, sorted, states[i] from sourceStart[i] to sourceStart[i + 1].
+    vector<size_t> sourceStart;
+    vector<size_t> sources;
+
+    // Sorted event ids, and one row of targets per state, columns indexed like events.
+    vector<unsigned> events;
+    StateDispatchTable eventTable;
+
+    vector<GlobalTransition> globalTransitions;
+
+    uint64_t generation;
+    StateMapping mapping;
+};
+
+#endif // STATEDEFINITION_HPP
@@ -0,0 +1,139 @@
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "StateDefinitionDomain.hpp"
+
+using namespace std;
+
+const uint64_t StateDefinitionDomain::freeSlot;
+
+StateDefinitionDomain::StateDefinitionDomain(StateDefinition *definition)
+{
+    nextGeneration = 1;
+
+    // An empty domain still needs a definition for machines to run from.
+    if (definition == nullptr)
+    {
+        definition = new StateDefinition();
+    }
+
+    definition->generation = nextGeneration++;
+    definition->mapping = StateDefinition::mapByName;
+
+    current.store(definition, memory_order_release);
+}
+
+StateDefinitionDomain::~StateDefinitionDomain()
+{
+    for (auto definition : retired)
+    {
+        delete definition;
+    }
+
+    for (auto reader : readers)
+    {
+        delete reader;
+    }
+
+    delete current.load(memory_order_acquire);
+}
+
+bool StateDefinitionDomain::publish(StateDefinition *definition, StateDefinition::StateMapping mapping)
+{
+    if (definition == nullptr || definition->generation != 0)
+    {
+        return false;
+    }
+
+    lock_guard<mutex> lock(publishing);
+
+    definition->generation = nextGeneration++;
+    definition->mapping = mapping != nullptr ? mapping : StateDefinition::mapByName;
+
+    // Machines that still hold the old definition keep their reader slot at its generation (or older), so it stays alive.
+    retired.push_back(const_cast<StateDefinition *>(current.exchange(definition, memory_order_seq_cst)));
+
+    reclaimLocked();
+
+    return true;
+}
+
+size_t StateDefinitionDomain::reclaim()
+{
+    lock_guard<mutex> lock(publishing);
+
+    return reclaimLocked();
+}
+
+size_t StateDefinitionDomain::reclaimLocked()
+{
+    uint64_t oldestInUse = freeSlot;
+
+    for (auto reader : readers)
+    {
+        uint64_t generation = reader->generation.load(memory_order_seq_cst);
+
+        oldestInUse = generation < oldestInUse ? generation : oldestInUse;
+    }
+
+    // A machine at generation g may be moving to any newer definition, so only definitions older than every slot can go.
+    size_t reclaimed = 0;
+
+    for (size_t i = retired.size(); i > 0; i--)
+    {
+        if (retired[i - 1]->generation < oldestInUse)
+        {
+            delete retired[i - 1];
+            retired.erase(retired.begin() + (i - 1));
+            reclaimed++;
+        }
+    }
+
+    return reclaimed;
+}
+
+size_t StateDefinitionDomain::getRetiredCount()
+{
+    lock_guard<mutex> lock(publishing);
+
+    return retired.size();
+}
+
+StateDefinitionDomain::ReaderSlot *StateDefinitionDomain::acquireReader(const StateDefinition *&definition)
+{
+    lock_guard<mutex> lock(publishing);
+
+    ReaderSlot *reader;
+
+    if (!freeReaders.empty())
+    {
+        reader = freeReaders.back();
+        freeReaders.pop_back();
+    }
+    else
+    {
+        reader = new ReaderSlot();
+        readers.push_back(reader);
+    }
+
+    // Publishing holds the same lock, so the definition cannot be reclaimed before the slot protects it.
+    if (definition == nullptr)
+    {
+        definition = current.load(memory_order_acquire);
+    }
+
+    reader->generation.store(definition->generation, memory_order_seq_cst);
+
+    return reader;
+}
+
+void StateDefinitionDomain::releaseReader(ReaderSlot *reader)
+{
+    lock_guard<mutex> lock(publishing);
+
+    reader->generation.store(freeSlot, memory_order_seq_cst);
+
+    freeReaders.push_back(reader);
+}
@@ -0,0 +1,121 @@
+/**
+ * @brief Publishes state machine definitions to running machines (RCU-style).
+ * @author Honzik Schenk
+ *
+ * StateDefinitionDomain holds the current StateDefinition of a family of
+ * StateMachine instances. Publishing a new definition swaps a pointer; every
+ * machine notices it at its next tick and moves over, mapping its active
+ * state to the new definition. Every machine owns a reader slot telling which
+ * generation of the definition it may still be using, so an old definition
+ * is deleted as soon as every machine has moved past it. Ticks only ever load
+ * the current pointer: publishing takes a lock, running never does.
+ */
+
+#ifndef STATEDEFINITIONDOMAIN_HPP
+#define STATEDEFINITIONDOMAIN_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "StateDefinition.hpp"
+
+using namespace std;
+
+class StateDefinitionDomain
+{
+public:
+    /**
+     * @brief Create a domain.
+     * @param definition The first definition (the domain takes ownership of it).
+     */
+    StateDefinitionDomain(StateDefinition *definition);
+
+    /**
+     * @brief Delete the current and the retired definitions.
+     *
+     * @warning Every machine running from the domain has to be destroyed first.
+     */
+    ~StateDefinitionDomain();
+
+    /**
+     * @brief Publish a new definition. Running machines move to it at their next tick.
+     * @param definition The new definition (the domain takes ownership of it).
+     * @param mapping Maps the active state of every machine to the new definition (StateDefinition::mapByName by default).
+     * @return True if the definition was published, false if it is nullptr or was already published.
+     */
+    bool publish(StateDefinition *definition, StateDefinition::StateMapping mapping = StateDefinition::mapByName);
+
+    /**
+     * @brief Delete the retired definitions no machine is using anymore.
+     * @return The number of definitions deleted.
+     *
+     * @note publish() reclaims too, call this to free memory between publications.
+     */
+    size_t reclaim();
+
+    /**
+     * @brief Get the number of retired definitions not deleted yet.
+     */
+    size_t getRetiredCount();
+
+    /**
+     * @brief Get the current definition. Lock-free.
+     */
+    const StateDefinition *getDefinition() const
+    {
+        return current.load(memory_order_acquire);
+    }
+
+private:
+    friend class StateFleet;
+    friend class StateMachine;
+
+    static const uint64_t freeSlot = UINT64_MAX;
+
+    // One per machine, on its own cache line: the generation of the oldest definition the machine may be using.
+    struct ReaderSlot
+    {
+        atomic<uint64_t> generation;
+        char padding[64 - sizeof(atomic<uint64_t>)];
+    };
+
+    atomic<const StateDefinition *> current;
+
+    // Slots are only added or freed while publishing is locked; a machine only touches its own.
+    vector<ReaderSlot *> readers;
+    vector<ReaderSlot *> freeReaders;
+
+    mutex publishing;
+    uint64_t nextGeneration;
+    vector<StateDefinition *> retired;
+
+    size_t reclaimLocked();
+
+    /**
+     * @brief Take a reader slot for a machine.
+     * @param definition The definition the machine starts with (protected by another machine), or nullptr for the current one.
+     * @return The slot, protecting the definition.
+     */
+    ReaderSlot *acquireReader(const StateDefinition *&definition);
+
+    /**
+     * @brief Give a reader slot back.
+     */
+    void releaseReader(ReaderSlot *reader);
+
+    /**
+     * @brief Announce that a machine moved to a definition and is done with older ones. Lock-free.
+     */
+    static void advanceReader(ReaderSlot *reader, const StateDefinition *definition)
+    {
+        reader->generation.store(definition->getGeneration(), memory_order_seq_cst);
+    }
+
+    StateDefinitionDomain(const StateDefinitionDomain &) = delete;
+    StateDefinitionDomain &operator=(const StateDefinitionDomain &) = delete;
+};
+
+#endif // STATEDEFINITIONDOMAIN_HPP
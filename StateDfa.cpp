@@ -0,0 +1,772 @@
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "StateDfa.hpp"
+
+using namespace std;
+
+namespace
+{
+    unsigned lowestBit(unsigned bits)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<unsigned>(__builtin_ctz(bits));
+#else
+        unsigned bit = 0;
+
+        while (!(bits & 1))
+        {
+            bits >>= 1;
+            bit++;
+        }
+
+        return bit;
+#endif
+    }
+}
+
+const size_t StateDfa::noState;
+const size_t StateDfa::maxSkipBytes;
+const uint32_t StateDfa::markedBit;
+const uint32_t StateDfa::skipBit;
+const unsigned StateDfa::rowShift;
+
+StateDfa::StateDfa()
+{
+    initialState = 0;
+    compiled = false;
+    classCount = 0;
+    actionContext = nullptr;
+    activeRow = 0;
+
+    memset(byteClass, 0, sizeof(byteClass));
+}
+
+size_t StateDfa::findState(const string &stateName) const
+{
+    for (size_t i = 0; i < stateNames.size(); i++)
+    {
+        if (stateNames[i] == stateName)
+        {
+            return i;
+        }
+    }
+
+    for (auto &merged : mergedNames)
+    {
+        if (merged.first == stateName)
+        {
+            return merged.second;
+        }
+    }
+
+    return noState;
+}
+
+bool StateDfa::addState(const string &stateName)
+{
+    if (findState(stateName) != noState)
+    {
+        return false;
+    }
+
+    size_t state = stateNames.size();
+    stateNames.push_back(stateName);
+
+    // Every byte leaves the new state unchanged until transitions are added.
+    for (uint32_t byte = 0; byte < 256; byte++)
+    {
+        nextByByte.push_back(static_cast<uint32_t>(state));
+        actionByByte.push_back(0);
+    }
+
+    compiled = false;
+
+    return true;
+}
+
+bool StateDfa::addTransition(const string &fromState, uint8_t first, uint8_t last, const string &toState, Action action)
+{
+    size_t from = findState(fromState);
+    size_t to = findState(toState);
+
+    if (from == noState || to == noState)
+    {
+        return false;
+    }
+
+    uint16_t actionId = 0;
+
+    if (action != nullptr)
+    {
+        // Transitions sharing an action share its id, so they can share a byte class.
+        size_t index = 0;
+
+        while (index < actions.size() && actions[index] != action)
+        {
+            index++;
+        }
+
+        if (index == actions.size())
+        {
+            if (actions.size() >= 0xFFFF)
+            {
+                return false;
+            }
+
+            actions.push_back(action);
+        }
+
+        actionId = static_cast<uint16_t>(index + 1);
+    }
+
+    for (uint32_t byte = first; byte <= last; byte++)
+    {
+        nextByByte[from * 256 + byte] = static_cast<uint32_t>(to);
+        actionByByte[from * 256 + byte] = actionId;
+    }
+
+    compiled = false;
+
+    return true;
+}
+
+bool StateDfa::setInitialState(const string &stateName)
+{
+    size_t state = findState(stateName);
+
+    if (state == noState)
+    {
+        return false;
+    }
+
+    initialState = state;
+
+    return true;
+}
+
+bool StateDfa::compile()
+{
+    size_t stateCount = stateNames.size();
+
+    if (stateCount == 0)
+    {
+        return false;
+    }
+
+    size_t activeState = getActiveState();
+
+    // Split the bytes into classes by refining with every state: two bytes stay in one class only if
+    // every state sends them to the same state with the same action.
+    vector<uint32_t> classOf(256, 0);
+    size_t classes = 1;
+
+    for (size_t s = 0; s < stateCount && classes < 256; s++)
+    {
+        map<pair<uint32_t, uint64_t>, uint32_t> refined;
+
+        for (size_t byte = 0; byte < 256; byte++)
+        {
+            uint64_t behavior = (static_cast<uint64_t>(nextByByte[s * 256 + byte]) << 16) | actionByByte[s * 256 + byte];
+            pair<uint32_t, uint64_t> key(classOf[byte], behavior);
+
+            map<pair<uint32_t, uint64_t>, uint32_t>::iterator found = refined.find(key);
+
+            if (found == refined.end())
+            {
+                found = refined.insert(make_pair(key, static_cast<uint32_t>(refined.size()))).first;
+            }
+
+            classOf[byte] = found->second;
+        }
+
+        classes = refined.size();
+    }
+
+    // Number the classes in the order of their first byte, with a representative byte for each. The classes
+    // only replace byteClass once the table fits, so a failed compile leaves the previous table usable.
+    uint8_t newByteClass[256];
+    vector<uint32_t> renumbered(256, 0xFFFFFFFF);
+    vector<size_t> representative;
+
+    for (size_t byte = 0; byte < 256; byte++)
+    {
+        if (renumbered[classOf[byte]] == 0xFFFFFFFF)
+        {
+            renumbered[classOf[byte]] = static_cast<uint32_t>(representative.size());
+            representative.push_back(byte);
+        }
+
+        newByteClass[byte] = static_cast<uint8_t>(renumbered[classOf[byte]]);
+    }
+
+    size_t newClassCount = representative.size();
+
+    // Rows are stored shifted left by rowShift in 32-bit entries.
+    if (stateCount * newClassCount > (size_t(1) << (32 - rowShift)) - 1)
+    {
+        return false;
+    }
+
+    memcpy(byteClass, newByteClass, sizeof(byteClass));
+    skipByteCount.assign(stateCount, 0);
+    skipBytes.assign(stateCount * maxSkipBytes, 0);
+
+    for (size_t s = 0; s < stateCount; s++)
+    {
+        size_t exits = 0;
+
+        for (size_t byte = 0; byte < 256; byte++)
+        {
+            if (nextByByte[s * 256 + byte] == s && actionByByte[s * 256 + byte] == 0)
+            {
+                continue;
+            }
+
+            if (exits < maxSkipBytes)
+            {
+                skipBytes[s * maxSkipBytes + exits] = static_cast<uint8_t>(byte);
+            }
+
+            exits++;
+        }
+
+        skipByteCount[s] = static_cast<uint8_t>(exits <= maxSkipBytes ? exits : maxSkipBytes + 1);
+    }
+
+    table.assign(stateCount * newClassCount, 0);
+    actionTable.assign(stateCount * newClassCount, 0);
+
+    for (size_t s = 0; s < stateCount; s++)
+    {
+        for (size_t c = 0; c < newClassCount; c++)
+        {
+            size_t byte = representative[c];
+            uint32_t next = nextByByte[s * 256 + byte];
+            uint16_t action = actionByByte[s * 256 + byte];
+
+            uint32_t entry = static_cast<uint32_t>(next * newClassCount) << rowShift;
+            entry |= action != 0 ? markedBit : 0;
+            entry |= skipByteCount[next] <= maxSkipBytes ? skipBit : 0;
+
+            table[s * newClassCount + c] = entry;
+            actionTable[s * newClassCount + c] = action != 0 ? static_cast<uint16_t>(action - 1) : 0;
+        }
+    }
+
+    classCount = newClassCount;
+    activeRow = static_cast<uint32_t>(activeState * classCount);
+    compiled = true;
+
+    return true;
+}
+
+void StateDfa::feed(const uint8_t *data, size_t size)
+{
+    if (!compiled && !compile())
+    {
+        return;
+    }
+
+    feedRow(activeRow, actionContext, data, size);
+}
+
+void StateDfa::feedRow(uint32_t &streamRow, void *context, const uint8_t *data, size_t size) const
+{
+    const uint8_t *position = data;
+    const uint8_t *end = data + size;
+    const uint32_t *next = table.data();
+    uint32_t row = streamRow;
+
+    if (skipByteCount[row / classCount] <= maxSkipBytes)
+    {
+        position = skipAhead(row / classCount, position, end);
+    }
+
+    while (position < end)
+    {
+        uint32_t index = row + byteClass[*position];
+        uint32_t entry = next[index];
+
+        row = entry >> rowShift;
+
+        if (entry & (markedBit | skipBit))
+        {
+            if (entry & markedBit)
+            {
+                actions[actionTable[index]](context, position);
+            }
+
+            position++;
+
+            if (entry & skipBit)
+            {
+                position = skipAhead(row / classCount, position, end);
+            }
+
+            continue;
+        }
+
+        position++;
+    }
+
+    streamRow = row;
+}
+
+void StateDfa::feedStream(Stream &stream) const
+{
+    uint32_t row = static_cast<uint32_t>((stream.state == noState ? initialState : stream.state) * classCount);
+
+    feedRow(row, stream.context, stream.data, stream.size);
+
+    stream.state = row / classCount;
+    stream.data += stream.size;
+    stream.size = 0;
+}
+
+template <size_t K>
+void StateDfa::feedInterleaved(Stream *streams)
+{
+    if (!compiled && !compile())
+    {
+        return;
+    }
+
+    const uint32_t *next = table.data();
+    uint32_t rows[K];
+    const uint8_t *data[K];
+    size_t common = streams[0].size;
+
+    for (size_t k = 0; k < K; k++)
+    {
+        rows[k] = static_cast<uint32_t>((streams[k].state == noState ? initialState : streams[k].state) * classCount);
+        data[k] = streams[k].data;
+        common = streams[k].size < common ? streams[k].size : common;
+    }
+
+    // Every step advances every stream by a byte; the K lookups of a step do not depend on each other.
+    for (size_t i = 0; i < common; i++)
+    {
+        for (size_t k = 0; k < K; k++)
+        {
+            uint32_t index = rows[k] + byteClass[data[k][i]];
+            uint32_t entry = next[index];
+
+            if (entry & markedBit)
+            {
+                actions[actionTable[index]](streams[k].context, data[k] + i);
+            }
+
+            rows[k] = entry >> rowShift;
+        }
+    }
+
+    for (size_t k = 0; k < K; k++)
+    {
+        streams[k].state = rows[k] / classCount;
+        streams[k].data += common;
+        streams[k].size -= common;
+
+        feedStream(streams[k]);
+    }
+}
+
+template void StateDfa::feedInterleaved<2>(Stream *streams);
+template void StateDfa::feedInterleaved<4>(Stream *streams);
+template void StateDfa::feedInterleaved<8>(Stream *streams);
+template void StateDfa::feedInterleaved<16>(Stream *streams);
+
+void StateDfa::feed(Stream *streams, size_t count)
+{
+    if (!compiled && !compile())
+    {
+        return;
+    }
+
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        feedInterleaved<8>(streams + i);
+    }
+
+    for (; i + 4 <= count; i += 4)
+    {
+        feedInterleaved<4>(streams + i);
+    }
+
+    for (; i < count; i++)
+    {
+        feedStream(streams[i]);
+    }
+}
+
+const uint8_t *StateDfa::skipAhead(size_t state, const uint8_t *position, const uint8_t *end) const
+{
+    size_t count = skipByteCount[state];
+    const uint8_t *bytes = &skipBytes[state * maxSkipBytes];
+
+    if (count == 0)
+    {
+        return end;
+    }
+
+    if (count == 1)
+    {
+        const void *found = memchr(position, bytes[0], static_cast<size_t>(end - position));
+
+        return found != nullptr ? static_cast<const uint8_t *>(found) : end;
+    }
+
+    uint8_t first = bytes[0];
+    uint8_t second = bytes[1];
+    uint8_t third = count == 3 ? bytes[2] : bytes[1];
+
+#if defined(__SSE2__) || defined(_M_X64)
+    __m128i firstBytes = _mm_set1_epi8(static_cast<char>(first));
+    __m128i secondBytes = _mm_set1_epi8(static_cast<char>(second));
+    __m128i thirdBytes = _mm_set1_epi8(static_cast<char>(third));
+
+    while (end - position >= 16)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(position));
+        __m128i matches = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, firstBytes), _mm_cmpeq_epi8(chunk, secondBytes)), _mm_cmpeq_epi8(chunk, thirdBytes));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(matches));
+
+        if (mask != 0)
+        {
+            return position + lowestBit(mask);
+        }
+
+        position += 16;
+    }
+#endif
+
+    while (position < end && *position != first && *position != second && *position != third)
+    {
+        position++;
+    }
+
+    return position;
+}
+
+void StateDfa::reset()
+{
+    activeRow = static_cast<uint32_t>(initialState * classCount);
+}
+
+size_t StateDfa::getActiveState() const
+{
+    if (stateNames.empty())
+    {
+        return noState;
+    }
+
+    return classCount == 0 ? initialState : activeRow / classCount;
+}
+
+string StateDfa::getActiveStateName() const
+{
+    size_t state = getActiveState();
+
+    return state == noState ? string() : stateNames[state];
+}
+
+StateDfa::MinimizeReport StateDfa::minimize()
+{
+    MinimizeReport report;
+    report.statesBefore = stateNames.size();
+    report.statesAfter = stateNames.size();
+    report.classesBefore = 0;
+    report.classesAfter = 0;
+    report.tableBytesBefore = 0;
+    report.tableBytesAfter = 0;
+
+    if ((!compiled && !compile()))
+    {
+        return report;
+    }
+
+    report.classesBefore = classCount;
+    report.tableBytesBefore = getTableBytes();
+
+    size_t stateCount = stateNames.size();
+    size_t classes = classCount;
+
+    // Bytes of one class behave the same in every state, so the minimization only has to look at one byte per class.
+    vector<size_t> representative(classes);
+
+    for (size_t byte = 256; byte > 0; byte--)
+    {
+        representative[byteClass[byte - 1]] = byte - 1;
+    }
+
+    // The states whose transition on a class leads to a state, [class][target] as offsets into sources.
+    vector<size_t> sourceStart(classes * stateCount + 1, 0);
+    vector<size_t> sources(classes * stateCount);
+
+    for (size_t c = 0; c < classes; c++)
+    {
+        for (size_t s = 0; s < stateCount; s++)
+        {
+            sourceStart[c * stateCount + nextByByte[s * 256 + representative[c]] + 1]++;
+        }
+    }
+
+    for (size_t i = 1; i < sourceStart.size(); i++)
+    {
+        sourceStart[i] += sourceStart[i - 1];
+    }
+
+    vector<size_t> filled(sourceStart.begin(), sourceStart.end() - 1);
+
+    for (size_t c = 0; c < classes; c++)
+    {
+        for (size_t s = 0; s < stateCount; s++)
+        {
+            sources[filled[c * stateCount + nextByByte[s * 256 + representative[c]]]++] = s;
+        }
+    }
+
+    // The partition: the states of block b are elements[blockStart[b]] to elements[blockEnd[b] - 1].
+    vector<size_t> elements(stateCount);
+    vector<size_t> positionOf(stateCount);
+    vector<size_t> blockOf(stateCount);
+    vector<size_t> blockStart;
+    vector<size_t> blockEnd;
+
+    // Start with the states grouped by the actions their transitions fire.
+    map<vector<uint16_t>, size_t> blockBySignature;
+    vector<vector<size_t>> initialBlocks;
+
+    for (size_t s = 0; s < stateCount; s++)
+    {
+        vector<uint16_t> signature(classes);
+
+        for (size_t c = 0; c < classes; c++)
+        {
+            signature[c] = actionByByte[s * 256 + representative[c]];
+        }
+
+        map<vector<uint16_t>, size_t>::iterator found = blockBySignature.find(signature);
+
+        if (found == blockBySignature.end())
+        {
+            found = blockBySignature.insert(make_pair(signature, initialBlocks.size())).first;
+            initialBlocks.push_back(vector<size_t>());
+        }
+
+        initialBlocks[found->second].push_back(s);
+    }
+
+    size_t position = 0;
+
+    for (size_t b = 0; b < initialBlocks.size(); b++)
+    {
+        blockStart.push_back(position);
+
+        for (size_t s : initialBlocks[b])
+        {
+            elements[position] = s;
+            positionOf[s] = position;
+            blockOf[s] = b;
+            position++;
+        }
+
+        blockEnd.push_back(position);
+    }
+
+    // Hopcroft: every (block, class) pair is a splitter; all blocks but the largest start in the worklist.
+    vector<pair<size_t, size_t>> worklist;
+    vector<bool> inWorklist(blockStart.size() * classes, false);
+    size_t largest = 0;
+
+    for (size_t b = 1; b < blockStart.size(); b++)
+    {
+        largest = blockEnd[b] - blockStart[b] > blockEnd[largest] - blockStart[largest] ? b : largest;
+    }
+
+    for (size_t b = 0; b < blockStart.size(); b++)
+    {
+        for (size_t c = 0; c < classes && b != largest; c++)
+        {
+            worklist.push_back(make_pair(b, c));
+            inWorklist[b * classes + c] = true;
+        }
+    }
+
+    vector<size_t> marked(stateCount, 0);
+    vector<size_t> touched;
+    vector<size_t> splitter;
+
+    while (!worklist.empty())
+    {
+        size_t block = worklist.back().first;
+        size_t c = worklist.back().second;
+        worklist.pop_back();
+        inWorklist[block * classes + c] = false;
+
+        // The states of the splitter block may move while blocks are split, so copy them first.
+        splitter.assign(elements.begin() + blockStart[block], elements.begin() + blockEnd[block]);
+
+        // Move every state leading into the splitter block to the front of its own block.
+        for (size_t target : splitter)
+        {
+            for (size_t i = sourceStart[c * stateCount + target]; i < sourceStart[c * stateCount + target + 1]; i++)
+            {
+                size_t s = sources[i];
+                size_t b = blockOf[s];
+                size_t front = blockStart[b] + marked[b];
+
+                if (positionOf[s] < front)
+                {
+                    continue;
+                }
+
+                if (marked[b] == 0)
+                {
+                    touched.push_back(b);
+                }
+
+                size_t other = elements[front];
+                elements[front] = s;
+                elements[positionOf[s]] = other;
+                positionOf[other] = positionOf[s];
+                positionOf[s] = front;
+                marked[b]++;
+            }
+        }
+
+        for (size_t b : touched)
+        {
+            size_t markedCount = marked[b];
+            marked[b] = 0;
+
+            if (markedCount == blockEnd[b] - blockStart[b])
+            {
+                continue;
+            }
+
+            // The marked states become a new block.
+            size_t split = blockStart.size();
+            blockStart.push_back(blockStart[b]);
+            blockEnd.push_back(blockStart[b] + markedCount);
+            blockStart[b] += markedCount;
+            marked.resize(blockStart.size(), 0);
+            inWorklist.resize(blockStart.size() * classes, false);
+
+            for (size_t i = blockStart[split]; i < blockEnd[split]; i++)
+            {
+                blockOf[elements[i]] = split;
+            }
+
+            size_t smaller = blockEnd[split] - blockStart[split] <= blockEnd[b] - blockStart[b] ? split : b;
+
+            for (size_t d = 0; d < classes; d++)
+            {
+                size_t add = inWorklist[b * classes + d] ? split : smaller;
+
+                if (!inWorklist[add * classes + d])
+                {
+                    worklist.push_back(make_pair(add, d));
+                    inWorklist[add * classes + d] = true;
+                }
+            }
+        }
+
+        touched.clear();
+    }
+
+    size_t blockCount = blockStart.size();
+
+    if (blockCount == stateCount)
+    {
+        report.classesAfter = classCount;
+        report.tableBytesAfter = getTableBytes();
+
+        return report;
+    }
+
+    // Number the merged states in the order of their first original state, which also names them.
+    vector<size_t> newStateOfBlock(blockCount, noState);
+    vector<size_t> newStateOf(stateCount);
+    vector<size_t> firstOfNewState;
+
+    for (size_t s = 0; s < stateCount; s++)
+    {
+        size_t &mapped = newStateOfBlock[blockOf[s]];
+
+        if (mapped == noState)
+        {
+            mapped = firstOfNewState.size();
+            firstOfNewState.push_back(s);
+        }
+
+        newStateOf[s] = mapped;
+    }
+
+    vector<string> newNames(blockCount);
+    vector<uint32_t> newNextByByte(blockCount * 256);
+    vector<uint16_t> newActionByByte(blockCount * 256);
+
+    for (size_t n = 0; n < blockCount; n++)
+    {
+        size_t s = firstOfNewState[n];
+
+        newNames[n] = stateNames[s];
+
+        for (size_t byte = 0; byte < 256; byte++)
+        {
+            newNextByByte[n * 256 + byte] = static_cast<uint32_t>(newStateOf[nextByByte[s * 256 + byte]]);
+            newActionByByte[n * 256 + byte] = actionByByte[s * 256 + byte];
+        }
+    }
+
+    for (auto &merged : mergedNames)
+    {
+        merged.second = newStateOf[merged.second];
+    }
+
+    for (size_t s = 0; s < stateCount; s++)
+    {
+        if (firstOfNewState[newStateOf[s]] != s)
+        {
+            mergedNames.push_back(make_pair(stateNames[s], newStateOf[s]));
+        }
+    }
+
+    size_t activeState = newStateOf[getActiveState()];
+
+    stateNames.swap(newNames);
+    nextByByte.swap(newNextByByte);
+    actionByByte.swap(newActionByByte);
+    initialState = newStateOf[initialState];
+
+    // compile() keeps the active state through activeRow, which is still counted in the old classes.
+    activeRow = static_cast<uint32_t>(activeState * classCount);
+    compile();
+
+    report.statesAfter = stateNames.size();
+    report.classesAfter = classCount;
+    report.tableBytesAfter = getTableBytes();
+
+    return report;
+}
+
+string StateDfa::MinimizeReport::toString() const
+{
+    ostringstream out;
+
+    out << "states: " << statesBefore << " -> " << statesAfter << ", byte classes: " << classesBefore << " -> " << classesAfter << ", table bytes: " << tableBytesBefore << " -> " << tableBytesAfter << "\n";
+
+    return out.str();
+}
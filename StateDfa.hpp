@@ -0,0 +1,258 @@
+/**
+ * @brief A table-driven state machine over bytes, for parsing wire protocols.
+ * @author Honzik Schenk
+ *
+ * StateDfa is built from states and byte transitions (ex: "in Header, the
+ * bytes '\r' go to HeaderEnd") and compiled into a dense next-state table
+ * indexed by [state][byte class]. Bytes that behave the same in every state
+ * share a class, so the table is much narrower than 256 columns. feed() runs
+ * whole buffers through the table in a tight loop: one load per byte, no
+ * calls, and actions only fire on transitions marked with one.
+ *
+ * Many independent streams (ex: one per connection) can share one compiled
+ * machine. Feeding them together interleaves their lookups, so the chains of
+ * dependent loads of several streams overlap instead of running one by one.
+ *
+ * minimize() merges equivalent states (Hopcroft's algorithm) before the
+ * table is compiled, which also lets more bytes share a class, so large
+ * generated machines shrink to a table that fits in the L1 or L2 cache.
+ *
+ * States that most bytes leave unchanged (ex: inside a quoted string, where
+ * only '"' and '\\' matter) are skipped ahead with a SIMD scan for the few
+ * bytes that leave them, so long runs cost a fraction of a load per byte.
+ */
+
+#ifndef STATEDFA_HPP
+#define STATEDFA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+class StateDfa
+{
+public:
+    /**
+     * @brief Called when a marked transition is taken.
+     * @param context The context set with setActionContext().
+     * @param position The byte that made the transition.
+     */
+    typedef void (*Action)(void *context, const uint8_t *position);
+
+    static const size_t noState = static_cast<size_t>(-1);
+
+    /**
+     * @brief States that at most this many bytes leave are skipped ahead with a SIMD scan.
+     */
+    static const size_t maxSkipBytes = 3;
+
+    /**
+     * @brief An independent input stream running through the machine.
+     */
+    struct Stream
+    {
+        // The bytes still to be processed, consumed by feed().
+        const uint8_t *data;
+        size_t size;
+
+        // Passed to the actions instead of the context set with setActionContext().
+        void *context;
+
+        // The index of the active state of the stream (noState for the initial state).
+        size_t state;
+
+        Stream() : data(nullptr), size(0), context(nullptr), state(noState) {}
+    };
+
+    StateDfa();
+
+    /**
+     * @brief Add a state. Bytes without a transition leave a state unchanged.
+     * @param stateName The name of the new state.
+     * @return True if the state was added successfully, false if the state already exists.
+     *
+     * @note The first state added is the initial state, unless setInitialState() is called.
+     */
+    bool addState(const string &stateName);
+
+    /**
+     * @brief Add a transition taken on a range of bytes.
+     * @param fromState The name of the state the transition starts from.
+     * @param first The first byte of the range.
+     * @param last The last byte of the range (inclusive).
+     * @param toState The name of the state to transition to.
+     * @param action The function to call when the transition is taken, or nullptr.
+     * @return True if the transition was added successfully, false if either state was not found.
+     *
+     * @note Later transitions replace earlier ones on the same bytes.
+     */
+    bool addTransition(const string &fromState, uint8_t first, uint8_t last, const string &toState, Action action = nullptr);
+
+    /**
+     * @brief Add a transition taken on a single byte.
+     */
+    bool addTransition(const string &fromState, uint8_t byte, const string &toState, Action action = nullptr)
+    {
+        return addTransition(fromState, byte, byte, toState, action);
+    }
+
+    /**
+     * @brief Set the state the machine starts in and returns to with reset().
+     * @return True if the state was found.
+     */
+    bool setInitialState(const string &stateName);
+
+    /**
+     * @brief Set the context passed to every action.
+     */
+    void setActionContext(void *context)
+    {
+        actionContext = context;
+    }
+
+    /**
+     * @brief Compile the states and transitions into the next-state table.
+     * @return True if the table was compiled, false if there are no states.
+     *
+     * @note feed() compiles automatically after states or transitions change.
+     */
+    bool compile();
+
+    struct MinimizeReport
+    {
+        size_t statesBefore;
+        size_t statesAfter;
+        size_t classesBefore;
+        size_t classesAfter;
+        size_t tableBytesBefore;
+        size_t tableBytesAfter;
+
+        /**
+         * @brief Format the report for logging.
+         */
+        string toString() const;
+    };
+
+    /**
+     * @brief Merge the states that no input can tell apart, then compile the smaller table.
+     * @return The number of states, byte classes and table bytes before and after.
+     *
+     * @note Two states are merged if every byte sequence fires the same actions from both. The merged state keeps
+     * the name of the state added first, the other names still refer to it.
+     * @warning The states of Stream objects refer to the states before minimization; reset them (state = noState).
+     */
+    MinimizeReport minimize();
+
+    /**
+     * @brief Run a buffer through the machine.
+     * @param data The bytes to process.
+     * @param size The number of bytes.
+     *
+     * @note The machine keeps its state between calls, so a stream can be fed in chunks.
+     */
+    void feed(const uint8_t *data, size_t size);
+
+    /**
+     * @brief Run several streams through the machine, interleaving their table lookups.
+     * @param streams The streams. All their data is processed, and data and size are left at the end of it.
+     * @param count The number of streams.
+     *
+     * @note Streams are run in groups of 8 (then 4) in lockstep. States are not skipped ahead while in lockstep,
+     * the bytes of the longer streams left over after it are.
+     */
+    void feed(Stream *streams, size_t count);
+
+    /**
+     * @brief Run exactly K streams through the machine in lockstep (K = 2, 4, 8 or 16).
+     * @param streams The K streams.
+     */
+    template <size_t K>
+    void feedInterleaved(Stream *streams);
+
+    /**
+     * @brief Return to the initial state.
+     */
+    void reset();
+
+    /**
+     * @brief Get the index of the active state (states are numbered in the order they were added).
+     */
+    size_t getActiveState() const;
+
+    /**
+     * @brief Get the name of the active state (empty if there are no states).
+     */
+    string getActiveStateName() const;
+
+    /**
+     * @brief Get the number of states.
+     */
+    size_t size() const
+    {
+        return stateNames.size();
+    }
+
+    /**
+     * @brief Get the number of byte classes of the compiled table.
+     */
+    size_t getClassCount() const
+    {
+        return classCount;
+    }
+
+    /**
+     * @brief Get the size of the compiled next-state table in bytes.
+     */
+    size_t getTableBytes() const
+    {
+        return table.size() * sizeof(uint32_t);
+    }
+
+private:
+    // A table entry is the row of the next state (its index times classCount) shifted left by two,
+    // with a bit telling if the transition has an action and one telling if the next state can be skipped ahead.
+    static const uint32_t markedBit = 1;
+    static const uint32_t skipBit = 2;
+    static const unsigned rowShift = 2;
+
+    vector<string> stateNames;
+
+    // Names of states merged into another state by minimize().
+    vector<pair<string, size_t>> mergedNames;
+
+    // The transitions as written, [state * 256 + byte]: the next state and the action (0 for none, else index + 1).
+    vector<uint32_t> nextByByte;
+    vector<uint16_t> actionByByte;
+    vector<Action> actions;
+
+    size_t initialState;
+    bool compiled;
+
+    uint8_t byteClass[256];
+    size_t classCount;
+    vector<uint32_t> table;
+
+    // Only read for marked transitions, same layout as table.
+    vector<uint16_t> actionTable;
+
+    // The bytes leaving every state that can be skipped ahead.
+    vector<uint8_t> skipByteCount;
+    vector<uint8_t> skipBytes;
+
+    void *actionContext;
+    uint32_t activeRow;
+
+    size_t findState(const string &stateName) const;
+
+    void feedRow(uint32_t &streamRow, void *context, const uint8_t *data, size_t size) const;
+
+    void feedStream(Stream &stream) const;
+
+    const uint8_t *skipAhead(size_t state, const uint8_t *position, const uint8_t *end) const;
+};
+
+#endif // STATEDFA_HPP
@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "StateDispatchTable.hpp"
+
+using namespace std;
+
+const uint32_t StateDispatchTable::noTarget;
+const size_t StateDispatchTable::compressBelowDensity;
+
+StateDispatchTable::StateDispatchTable()
+{
+    reset(0, 0);
+}
+
+void StateDispatchTable::reset(size_t stateCount, size_t eventCount)
+{
+    this->stateCount = stateCount;
+    this->eventCount = eventCount;
+
+    entries.clear();
+
+    // An empty table is compressed into nothing but padding, however many states and events it has.
+    compile(Compressed);
+}
+
+bool StateDispatchTable::set(size_t state, size_t event, uint32_t target)
+{
+    if (state >= stateCount || event >= eventCount)
+    {
+        return false;
+    }
+
+    Entry entry;
+    entry.state = static_cast<uint32_t>(state);
+    entry.event = static_cast<uint32_t>(event);
+    entry.target = target;
+
+    entries.push_back(entry);
+
+    return true;
+}
+
+void StateDispatchTable::sortEntries()
+{
+    // Stable, so of several entries for the same state and event the last one set comes last.
+    stable_sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.state != b.state ? a.state < b.state : a.event < b.event; });
+
+    size_t kept = 0;
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        bool replaced = i + 1 < entries.size() && entries[i + 1].state == entries[i].state && entries[i + 1].event == entries[i].event;
+
+        if (!replaced)
+        {
+            entries[kept++] = entries[i];
+        }
+    }
+
+    entries.resize(kept);
+    entryCount = kept;
+}
+
+void StateDispatchTable::compile()
+{
+    sortEntries();
+
+    if (entryCount * compressBelowDensity >= stateCount * eventCount)
+    {
+        compileDense();
+        return;
+    }
+
+    compileCompressed();
+
+    // Rows that do not interlock well can leave so many holes that the dense table is smaller after all.
+    if (getTableBytes() >= getDenseBytes())
+    {
+        compileDense();
+    }
+}
+
+void StateDispatchTable::compile(Layout layout)
+{
+    sortEntries();
+
+    if (layout == Dense)
+    {
+        compileDense();
+    }
+    else
+    {
+        compileCompressed();
+    }
+}
+
+void StateDispatchTable::compileDense()
+{
+    layout = Dense;
+
+    dense.assign(stateCount * eventCount, noTarget);
+
+    for (auto &entry : entries)
+    {
+        dense[entry.state * eventCount + entry.event] = entry.target;
+    }
+
+    vector<uint32_t>().swap(rowBase);
+    vector<Slot>().swap(slots);
+}
+
+void StateDispatchTable::compileCompressed()
+{
+    layout = Compressed;
+
+    // The entries of every row, rows with the most entries first: they are the hardest to place, and the small
+    // rows placed after them fill their holes (first fit decreasing).
+    vector<size_t> rowStart(stateCount + 1, 0);
+
+    for (auto &entry : entries)
+    {
+        rowStart[entry.state + 1]++;
+    }
+
+    for (size_t state = 0; state < stateCount; state++)
+    {
+        rowStart[state + 1] += rowStart[state];
+    }
+
+    vector<uint32_t> order(stateCount);
+
+    for (size_t state = 0; state < stateCount; state++)
+    {
+        order[state] = static_cast<uint32_t>(state);
+    }
+
+    // Rows with the same number of entries: the widest first, as its entries leave the fewest bases to choose from.
+    stable_sort(order.begin(), order.end(), [this, &rowStart](uint32_t a, uint32_t b) {
+        size_t countA = rowStart[a + 1] - rowStart[a];
+        size_t countB = rowStart[b + 1] - rowStart[b];
+
+        if (countA != countB || countA == 0)
+        {
+            return countA > countB;
+        }
+
+        return entries[rowStart[a + 1] - 1].event - entries[rowStart[a]].event > entries[rowStart[b + 1] - 1].event - entries[rowStart[b]].event;
+    });
+
+    rowBase.assign(stateCount, 0);
+
+    // One bit per slot, set once an entry is placed in it. Every row takes at least one slot, so there are never
+    // more than entries + eventCount slots in use.
+    vector<uint64_t> used((entries.size() + eventCount) / 64 + 2, 0);
+
+    // The first slot at or after a slot that is still free.
+    auto nextFree = [&used](size_t slot) {
+        for (size_t word = slot / 64;; word++)
+        {
+            if (word >= used.size())
+            {
+                used.resize(word + 1, 0);
+            }
+
+            uint64_t free = ~used[word] & (word == slot / 64 ? ~uint64_t(0) << (slot % 64) : ~uint64_t(0));
+
+            if (free != 0)
+            {
+                return word * 64 + static_cast<size_t>(__builtin_ctzll(free));
+            }
+        }
+    };
+
+    auto isUsed = [&used](size_t slot) { return slot / 64 < used.size() && (used[slot / 64] >> (slot % 64) & 1) != 0; };
+
+    size_t firstFree = 0;
+    size_t lastBase = 0;
+
+    for (uint32_t state : order)
+    {
+        size_t first = rowStart[state];
+        size_t last = rowStart[state + 1];
+
+        // Rows without entries (the rest of them, as they come last) match no slot, whatever their base.
+        if (first == last)
+        {
+            break;
+        }
+
+        // The first entry of the row can only go to a free slot, so only the bases putting it on one are tried,
+        // starting at the first free slot.
+        size_t firstEvent = entries[first].event;
+        size_t slot = nextFree(max(firstFree, firstEvent));
+
+        for (;; slot = nextFree(slot + 1))
+        {
+            bool fits = true;
+
+            for (size_t i = first + 1; i < last && fits; i++)
+            {
+                fits = !isUsed(slot - firstEvent + entries[i].event);
+            }
+
+            if (fits)
+            {
+                break;
+            }
+        }
+
+        size_t base = slot - firstEvent;
+
+        for (size_t i = first; i < last; i++)
+        {
+            size_t placed = base + entries[i].event;
+
+            if (placed / 64 >= used.size())
+            {
+                used.resize(placed / 64 + 1, 0);
+            }
+
+            used[placed / 64] |= uint64_t(1) << (placed % 64);
+        }
+
+        firstFree = nextFree(firstFree);
+
+        rowBase[state] = static_cast<uint32_t>(base);
+        lastBase = max(lastBase, base);
+    }
+
+    // Padded with a whole row past the last base, so any state and event land in range.
+    Slot empty;
+    empty.state = noTarget;
+    empty.target = noTarget;
+
+    slots.assign(lastBase + eventCount, empty);
+
+    for (auto &entry : entries)
+    {
+        Slot &slot = slots[rowBase[entry.state] + entry.event];
+        slot.state = entry.state;
+        slot.target = entry.target;
+    }
+
+    vector<uint32_t>().swap(dense);
+}
+
+size_t StateDispatchTable::getTableBytes() const
+{
+    if (layout == Dense)
+    {
+        return dense.size() * sizeof(uint32_t);
+    }
+
+    return rowBase.size() * sizeof(uint32_t) + slots.size() * sizeof(Slot);
+}
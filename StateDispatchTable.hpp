@@ -0,0 +1,169 @@
+/**
+ * @brief A state x event table of transition targets, dense or compressed.
+ * @author Honzik Schenk
+ *
+ * StateDispatchTable maps a state and an event (both dense indexes) to the
+ * state to transition to. Small or well-filled tables are stored densely,
+ * one entry per state and event. Large machines rarely handle more than a
+ * few of their events in any state (ex: 10000 states x 500 events with a
+ * handful of transitions each), so sparse tables are compressed instead as
+ * a comb vector (row displacement): the rows are overlaid on one array of
+ * slots, each shifted so its entries fall into slots no other row uses, and
+ * every slot remembers the state it belongs to. A lookup is still a single
+ * load and a compare, while memory grows with the number of transitions
+ * instead of the number of states times the number of events.
+ */
+
+#ifndef STATEDISPATCHTABLE_HPP
+#define STATEDISPATCHTABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+class StateDispatchTable
+{
+public:
+    /**
+     * @brief Returned where a state does not handle an event.
+     */
+    static const uint32_t noTarget = static_cast<uint32_t>(-1);
+
+    /**
+     * @brief Tables with fewer entries than one in this many cells are compressed by compile().
+     */
+    static const size_t compressBelowDensity = 8;
+
+    enum Layout
+    {
+        Dense,
+        Compressed
+    };
+
+    StateDispatchTable();
+
+    /**
+     * @brief Remove every entry and set the size of the table.
+     * @param stateCount The number of states (rows).
+     * @param eventCount The number of events (columns).
+     */
+    void reset(size_t stateCount, size_t eventCount);
+
+    /**
+     * @brief Set the target of a state and an event.
+     * @param state The index of the state.
+     * @param event The index of the event.
+     * @param target The state to transition to.
+     * @return True if the entry was set, false if the state or the event is out of range.
+     *
+     * @note Later entries replace earlier ones. The table has to be compiled again before get() sees them.
+     */
+    bool set(size_t state, size_t event, uint32_t target);
+
+    /**
+     * @brief Compile the entries, choosing the layout by density.
+     *
+     * @note Sparse tables are only kept compressed if that makes them smaller than the dense layout.
+     */
+    void compile();
+
+    /**
+     * @brief Compile the entries into a given layout.
+     */
+    void compile(Layout layout);
+
+    /**
+     * @brief Get the target of a state and an event.
+     * @param state The index of the state (less than the state count).
+     * @param event The index of the event (less than the event count).
+     * @return The state to transition to, or noTarget.
+     */
+    uint32_t get(size_t state, size_t event) const
+    {
+        if (layout == Dense)
+        {
+            return dense[state * eventCount + event];
+        }
+
+        // The slots are padded past the last row, so the slot is always in range.
+        const Slot &slot = slots[rowBase[state] + event];
+
+        return slot.state == state ? slot.target : noTarget;
+    }
+
+    Layout getLayout() const
+    {
+        return layout;
+    }
+
+    size_t getStateCount() const
+    {
+        return stateCount;
+    }
+
+    size_t getEventCount() const
+    {
+        return eventCount;
+    }
+
+    /**
+     * @brief Get the number of state and event pairs with a target.
+     */
+    size_t getEntryCount() const
+    {
+        return entryCount;
+    }
+
+    /**
+     * @brief Get the size of the compiled table in bytes.
+     */
+    size_t getTableBytes() const;
+
+    /**
+     * @brief Get the size the table would have in the dense layout in bytes.
+     */
+    size_t getDenseBytes() const
+    {
+        return stateCount * eventCount * sizeof(uint32_t);
+    }
+
+private:
+    struct Entry
+    {
+        uint32_t state;
+        uint32_t event;
+        uint32_t target;
+    };
+
+    // The state is stored next to the target, so a compressed lookup touches a single cache line.
+    struct Slot
+    {
+        uint32_t state;
+        uint32_t target;
+    };
+
+    size_t stateCount;
+    size_t eventCount;
+
+    // The entries in the order they were set, sorted by state and event (and without duplicates) once compiled.
+    vector<Entry> entries;
+    size_t entryCount;
+
+    Layout layout;
+
+    vector<uint32_t> dense;
+
+    // The slot of the entry of a state and an event is rowBase[state] + event.
+    vector<uint32_t> rowBase;
+    vector<Slot> slots;
+
+    void sortEntries();
+
+    void compileDense();
+
+    void compileCompressed();
+};
+
+#endif // STATEDISPATCHTABLE_HPP
@@ -0,0 +1,344 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#include "StateEventQueue.hpp"
+
+using namespace std;
+
+const uint32_t StateEventQueue::keyToken;
+const unsigned StateEventQueue::coalesceEventLimit;
+const size_t StateEventQueue::overflowWords;
+
+StateEventQueue::StateEventQueue(size_t capacity, size_t coalescingKeys, OverflowPolicy overflowPolicy)
+{
+    size_t rounded = 2;
+
+    while (rounded < capacity)
+    {
+        rounded *= 2;
+    }
+
+    for (Lane &lane : lanes)
+    {
+        lane.cells = new Cell[rounded];
+        lane.mask = rounded - 1;
+
+        for (size_t i = 0; i < rounded; i++)
+        {
+            lane.cells[i].sequence.store(i, memory_order_relaxed);
+            lane.cells[i].token = 0;
+        }
+
+        lane.enqueuePosition.store(0, memory_order_relaxed);
+        lane.dequeuePosition.store(0, memory_order_relaxed);
+    }
+
+    coalescingKeyCount = coalescingKeys;
+    coalescingSlots = new atomic<uint32_t>[coalescingKeys == 0 ? 1 : coalescingKeys];
+
+    for (size_t i = 0; i < coalescingKeyCount; i++)
+    {
+        coalescingSlots[i].store(0, memory_order_relaxed);
+    }
+
+    coalescedEvents.store(0, memory_order_relaxed);
+    droppedEvents.store(0, memory_order_relaxed);
+
+    this->overflowPolicy.store(overflowPolicy, memory_order_relaxed);
+
+    for (int lane = Normal; lane <= High; lane++)
+    {
+        for (size_t w = 0; w < overflowWords; w++)
+        {
+            overflowEvents[lane][w].store(0, memory_order_relaxed);
+        }
+
+        overflowPending[lane].store(false, memory_order_relaxed);
+    }
+
+    highWatermark = 0;
+    onHighWatermark = nullptr;
+    highWatermarkArmed.store(true, memory_order_relaxed);
+}
+
+StateEventQueue::~StateEventQueue()
+{
+    for (Lane &lane : lanes)
+    {
+        delete[] lane.cells;
+    }
+
+    delete[] coalescingSlots;
+}
+
+bool StateEventQueue::push(Lane &lane, uint32_t token)
+{
+    size_t position = lane.enqueuePosition.load(memory_order_relaxed);
+
+    for (;;)
+    {
+        Cell &cell = lane.cells[position & lane.mask];
+        size_t sequence = cell.sequence.load(memory_order_acquire);
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+        if (difference == 0)
+        {
+            if (lane.enqueuePosition.compare_exchange_weak(position, position + 1, memory_order_relaxed))
+            {
+                cell.token = token;
+                cell.sequence.store(position + 1, memory_order_release);
+
+                return true;
+            }
+        }
+        else if (difference < 0)
+        {
+            return false;
+        }
+        else
+        {
+            position = lane.enqueuePosition.load(memory_order_relaxed);
+        }
+    }
+}
+
+bool StateEventQueue::take(Lane &lane, uint32_t &token)
+{
+    size_t position = lane.dequeuePosition.load(memory_order_relaxed);
+
+    for (;;)
+    {
+        Cell &cell = lane.cells[position & lane.mask];
+        size_t sequence = cell.sequence.load(memory_order_acquire);
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+
+        if (difference == 0)
+        {
+            if (lane.dequeuePosition.compare_exchange_weak(position, position + 1, memory_order_relaxed))
+            {
+                token = cell.token;
+                cell.sequence.store(position + lane.mask + 1, memory_order_release);
+
+                return true;
+            }
+        }
+        else if (difference < 0)
+        {
+            return false;
+        }
+        else
+        {
+            position = lane.dequeuePosition.load(memory_order_relaxed);
+        }
+    }
+}
+
+bool StateEventQueue::enqueue(Priority priority, uint32_t token)
+{
+    Lane &lane = lanes[priority];
+
+    for (;;)
+    {
+        if (push(lane, token))
+        {
+            if (highWatermark != 0 && size() >= highWatermark && highWatermarkArmed.exchange(false, memory_order_relaxed) && onHighWatermark != nullptr)
+            {
+                onHighWatermark(size());
+            }
+
+            return true;
+        }
+
+        switch (overflowPolicy.load(memory_order_relaxed))
+        {
+        case Block:
+            this_thread::yield();
+            break;
+
+        case DropOldest:
+        {
+            uint32_t oldest;
+
+            if (take(lane, oldest))
+            {
+                // A dropped key token takes the event waiting in its coalescing slot with it.
+                if (oldest & keyToken)
+                {
+                    coalescingSlots[oldest & ~keyToken].exchange(0, memory_order_acq_rel);
+                }
+
+                droppedEvents.fetch_add(1, memory_order_relaxed);
+            }
+
+            break;
+        }
+
+        case Coalesce:
+            if (!(token & keyToken) && token < coalesceEventLimit)
+            {
+                uint64_t bit = uint64_t(1) << (token % 64);
+                uint64_t previous = overflowEvents[priority][token / 64].fetch_or(bit, memory_order_acq_rel);
+
+                overflowPending[priority].store(true, memory_order_release);
+
+                if (previous & bit)
+                {
+                    coalescedEvents.fetch_add(1, memory_order_relaxed);
+                }
+
+                return true;
+            }
+
+            droppedEvents.fetch_add(1, memory_order_relaxed);
+
+            return false;
+
+        default:
+            droppedEvents.fetch_add(1, memory_order_relaxed);
+
+            return false;
+        }
+    }
+}
+
+bool StateEventQueue::takeOverflow(Priority priority, unsigned &event)
+{
+    if (!overflowPending[priority].load(memory_order_acquire))
+    {
+        return false;
+    }
+
+    overflowPending[priority].store(false, memory_order_relaxed);
+
+    for (size_t w = 0; w < overflowWords; w++)
+    {
+        uint64_t bits = overflowEvents[priority][w].load(memory_order_relaxed);
+
+        if (bits == 0)
+        {
+            continue;
+        }
+
+        uint64_t lowest = bits & (~bits + 1);
+
+        overflowEvents[priority][w].fetch_and(~lowest, memory_order_acq_rel);
+
+        unsigned bit = 0;
+
+        while (!((lowest >> bit) & 1))
+        {
+            bit++;
+        }
+
+        event = static_cast<unsigned>(w * 64 + bit);
+
+        // More events may be left, look again next time.
+        overflowPending[priority].store(true, memory_order_relaxed);
+
+        return true;
+    }
+
+    return false;
+}
+
+bool StateEventQueue::post(unsigned event, Priority priority)
+{
+    if (event >= keyToken)
+    {
+        return false;
+    }
+
+    return enqueue(priority, event);
+}
+
+bool StateEventQueue::post(unsigned event, size_t coalescingKey, Priority priority)
+{
+    if (event >= keyToken || coalescingKey >= coalescingKeyCount)
+    {
+        return false;
+    }
+
+    // The slot holds the pending event plus one (0 means empty). If an event was already pending,
+    // it is replaced in place and the token already in a lane delivers the new one.
+    uint32_t pending = coalescingSlots[coalescingKey].exchange(event + 1, memory_order_acq_rel);
+
+    if (pending != 0)
+    {
+        coalescedEvents.fetch_add(1, memory_order_relaxed);
+
+        return true;
+    }
+
+    if (enqueue(priority, keyToken | static_cast<uint32_t>(coalescingKey)))
+    {
+        return true;
+    }
+
+    // The lane is full: take the event back out. Without a token in a lane the slot would never be
+    // emptied again, so this also drops an event another producer may have coalesced into it meanwhile.
+    coalescingSlots[coalescingKey].exchange(0, memory_order_acq_rel);
+
+    return false;
+}
+
+bool StateEventQueue::pop(unsigned &event)
+{
+    if (!highWatermarkArmed.load(memory_order_relaxed) && size() < highWatermark / 2 + 1)
+    {
+        highWatermarkArmed.store(true, memory_order_relaxed);
+    }
+
+    uint32_t token;
+
+    for (;;)
+    {
+        if (!take(lanes[High], token))
+        {
+            if (takeOverflow(High, event))
+            {
+                return true;
+            }
+
+            if (!take(lanes[Normal], token))
+            {
+                return takeOverflow(Normal, event);
+            }
+        }
+
+        if (!(token & keyToken))
+        {
+            event = token;
+
+            return true;
+        }
+
+        uint32_t pending = coalescingSlots[token & ~keyToken].exchange(0, memory_order_acq_rel);
+
+        if (pending != 0)
+        {
+            event = pending - 1;
+
+            return true;
+        }
+    }
+}
+
+size_t StateEventQueue::size(Priority priority) const
+{
+    const Lane &lane = lanes[priority];
+
+    size_t enqueued = lane.enqueuePosition.load(memory_order_relaxed);
+    size_t dequeued = lane.dequeuePosition.load(memory_order_relaxed);
+
+    return enqueued > dequeued ? enqueued - dequeued : 0;
+}
+
+void StateEventQueue::setHighWatermark(size_t watermark, void (*onHighWatermark)(size_t pendingEvents))
+{
+    highWatermark = watermark;
+    this->onHighWatermark = onHighWatermark;
+
+    highWatermarkArmed.store(true, memory_order_relaxed);
+}
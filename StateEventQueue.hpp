@@ -0,0 +1,190 @@
+/**
+ * @brief A lock-free event queue for feeding a state manager from other threads.
+ * @author Honzik Schenk
+ *
+ * StateEventQueue has two lanes, high and normal priority, each a bounded
+ * multi-producer ring, so posting an event never takes a lock. The consumer
+ * always empties the high priority lane first, so an emergency stop is not
+ * stuck behind a backlog of telemetry. Events posted with a coalescing key
+ * replace the pending event with the same key in place instead of queueing
+ * up (ex: "value updated" events from a chatty sensor).
+ *
+ * What happens when a lane is full is decided by its overflow policy, and
+ * every dropped or coalesced event is counted, so the system degrades in a
+ * predictable way under load spikes.
+ */
+
+#ifndef STATEEVENTQUEUE_HPP
+#define STATEEVENTQUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+class StateEventQueue
+{
+public:
+    enum Priority
+    {
+        Normal,
+        High
+    };
+
+    enum OverflowPolicy
+    {
+        // Wait (yielding) until the consumer makes room.
+        Block,
+        // Drop the oldest event of the lane to make room.
+        DropOldest,
+        // Drop the event being posted.
+        DropNewest,
+        // Keep the event in a per-lane set of event ids, so repeated events are only delivered once
+        // (after the events in the lane).
+        Coalesce
+    };
+
+    /**
+     * @brief Event ids below this limit can be coalesced by the Coalesce overflow policy, others are dropped.
+     */
+    static const unsigned coalesceEventLimit = 1024;
+
+    /**
+     * @brief Create an event queue.
+     * @param capacity The number of events every lane can hold (rounded up to a power of two).
+     * @param coalescingKeys The number of coalescing keys (keys go from 0 to coalescingKeys - 1).
+     * @param overflowPolicy What to do when an event is posted to a full lane.
+     */
+    StateEventQueue(size_t capacity = 1024, size_t coalescingKeys = 64, OverflowPolicy overflowPolicy = DropNewest);
+
+    ~StateEventQueue();
+
+    /**
+     * @brief Post an event. Lock-free and safe to call from any thread.
+     * @param event The id of the event (below 2^31).
+     * @param priority The lane to post the event to.
+     * @return True if the event was queued (or coalesced), false if it was dropped.
+     *
+     * @warning With the Block policy, never post from the thread consuming the queue.
+     */
+    bool post(unsigned event, Priority priority = Normal);
+
+    /**
+     * @brief Post an event that replaces the pending event with the same coalescing key. Lock-free and safe to call from any thread.
+     * @param event The id of the event (below 2^31).
+     * @param coalescingKey The key of the event. A pending event with the same key is replaced in place.
+     * @param priority The lane to post the event to, if no event with the same key is pending.
+     * @return True if the event was queued or coalesced, false if it was dropped or the key is out of range.
+     */
+    bool post(unsigned event, size_t coalescingKey, Priority priority);
+
+    /**
+     * @brief Take the next event, high priority events first. Only call this from the consuming thread.
+     * @param event Set to the id of the event.
+     * @return True if an event was taken, false if the queue is empty.
+     */
+    bool pop(unsigned &event);
+
+    /**
+     * @brief Get the approximate number of pending events in a lane.
+     */
+    size_t size(Priority priority) const;
+
+    /**
+     * @brief Get the approximate number of pending events in both lanes.
+     */
+    size_t size() const
+    {
+        return size(High) + size(Normal);
+    }
+
+    /**
+     * @brief Get the number of events that replaced a pending event with the same coalescing key, or that overflowed
+     * while the same event was already waiting under the Coalesce policy.
+     */
+    uint64_t getCoalescedEvents() const
+    {
+        return coalescedEvents.load(memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of events dropped because a lane was full.
+     */
+    uint64_t getDroppedEvents() const
+    {
+        return droppedEvents.load(memory_order_relaxed);
+    }
+
+    /**
+     * @brief Change what happens when an event is posted to a full lane.
+     * @param overflowPolicy The new overflow policy.
+     */
+    void setOverflowPolicy(OverflowPolicy overflowPolicy)
+    {
+        this->overflowPolicy.store(overflowPolicy, memory_order_relaxed);
+    }
+
+    /**
+     * @brief Call a function when the number of pending events reaches a watermark.
+     * @param watermark The number of pending events (in both lanes) at which to call the function, or 0 to disable it.
+     * @param onHighWatermark The function to call with the number of pending events. It is called on the posting thread,
+     * once, and again only after the queue has drained to half the watermark.
+     *
+     * @note Set this before events are posted.
+     */
+    void setHighWatermark(size_t watermark, void (*onHighWatermark)(size_t pendingEvents));
+
+private:
+    // Bounded multi-producer, multi-consumer ring (Vyukov): every cell carries a sequence number
+    // telling producers and consumers whose turn it is, so neither side needs a lock.
+    struct Cell
+    {
+        atomic<size_t> sequence;
+        uint32_t token;
+    };
+
+    struct Lane
+    {
+        Cell *cells;
+        size_t mask;
+
+        alignas(64) atomic<size_t> enqueuePosition;
+        alignas(64) atomic<size_t> dequeuePosition;
+    };
+
+    static const uint32_t keyToken = 0x80000000u;
+
+    bool push(Lane &lane, uint32_t token);
+
+    bool take(Lane &lane, uint32_t &token);
+
+    bool enqueue(Priority priority, uint32_t token);
+
+    bool takeOverflow(Priority priority, unsigned &event);
+
+    Lane lanes[2];
+
+    atomic<int> overflowPolicy;
+
+    // Events that overflowed a lane under the Coalesce policy, one bit per event id.
+    static const size_t overflowWords = coalesceEventLimit / 64;
+    atomic<uint64_t> overflowEvents[2][overflowWords];
+    atomic<bool> overflowPending[2];
+
+    size_t highWatermark;
+    void (*onHighWatermark)(size_t pendingEvents);
+    atomic<bool> highWatermarkArmed;
+
+    atomic<uint64_t> droppedEvents;
+
+    atomic<uint32_t> *coalescingSlots;
+    size_t coalescingKeyCount;
+
+    atomic<uint64_t> coalescedEvents;
+
+    StateEventQueue(const StateEventQueue &) = delete;
+    StateEventQueue &operator=(const StateEventQueue &) = delete;
+};
+
+#endif // STATEEVENTQUEUE_HPP
@@ -0,0 +1,347 @@
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#endif
+
+#include "StateFleet.hpp"
+
+using namespace std;
+
+const size_t StateFleet::prefetchDistance;
+const uint32_t StateFleet::noState;
+
+thread_local void *StateFleet::currentContext = nullptr;
+
+namespace
+{
+    inline void prefetch(const void *address)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(address);
+#elif defined(_MSC_VER)
+        _mm_prefetch(static_cast<const char *>(address), _MM_HINT_T0);
+#endif
+    }
+}
+
+StateFleet::StateFleet(StateDefinitionDomain &domain)
+{
+    this->domain = &domain;
+
+    definition = nullptr;
+    reader = domain.acquireReader(definition);
+
+    instanceCount = 0;
+    buckets.resize(definition->size());
+}
+
+StateFleet::~StateFleet()
+{
+    domain->releaseReader(reader);
+}
+
+size_t StateFleet::addInstance(void *context)
+{
+    size_t compositeCount = definition->getCompositeCount();
+    size_t instance;
+
+    if (!freeInstances.empty())
+    {
+        instance = freeInstances.back();
+        freeInstances.pop_back();
+    }
+    else
+    {
+        instance = instances.size();
+        instances.push_back(Instance());
+        lastChild.resize(instances.size() * compositeCount);
+        lastLeaf.resize(instances.size() * compositeCount);
+    }
+
+    Instance &added = instances[instance];
+    added.context = context;
+    added.state = noState;
+    added.position = 0;
+    added.removed = false;
+
+    for (size_t c = 0; c < compositeCount; c++)
+    {
+        lastChild[instance * compositeCount + c] = StateDefinition::noState;
+        lastLeaf[instance * compositeCount + c] = StateDefinition::noState;
+    }
+
+    // The initial state is the active state of the state manager the definition was compiled from, always a leaf.
+    if (definition->getInitialState() != StateDefinition::noState)
+    {
+        addToBucket(static_cast<uint32_t>(instance), static_cast<uint32_t>(definition->getInitialState()));
+    }
+
+    instanceCount++;
+
+    return instance;
+}
+
+bool StateFleet::removeInstance(size_t instance)
+{
+    if (instance >= instances.size() || instances[instance].removed)
+    {
+        return false;
+    }
+
+    removeFromBucket(static_cast<uint32_t>(instance));
+
+    instances[instance].context = nullptr;
+    instances[instance].removed = true;
+    freeInstances.push_back(instance);
+    instanceCount--;
+
+    return true;
+}
+
+bool StateFleet::update()
+{
+    const StateDefinition *latest = domain->getDefinition();
+
+    if (latest == definition)
+    {
+        return false;
+    }
+
+    moveTo(latest);
+
+    return true;
+}
+
+void StateFleet::moveTo(const StateDefinition *latest)
+{
+    StateDefinition::StateMapping mapping = latest->mapping != nullptr ? latest->mapping : StateDefinition::mapByName;
+    vector<size_t> mapped(instances.size(), StateDefinition::noState);
+
+    for (size_t instance = 0; instance < instances.size(); instance++)
+    {
+        if (!instances[instance].removed)
+        {
+            size_t state = instances[instance].state != noState ? instances[instance].state : StateDefinition::noState;
+            mapped[instance] = mapping(*definition, state, *latest);
+        }
+    }
+
+    // The history of the old definition means nothing in the new one.
+    lastChild.assign(instances.size() * latest->getCompositeCount(), StateDefinition::noState);
+    lastLeaf.assign(instances.size() * latest->getCompositeCount(), StateDefinition::noState);
+
+    definition = latest;
+    buckets.assign(latest->size(), vector<uint32_t>());
+
+    for (size_t instance = 0; instance < instances.size(); instance++)
+    {
+        instances[instance].state = noState;
+
+        if (mapped[instance] < latest->size())
+        {
+            enterState(static_cast<uint32_t>(instance), mapped[instance]);
+        }
+    }
+
+    // Only now is the old definition no longer used, so it may be reclaimed.
+    StateDefinitionDomain::advanceReader(reader, latest);
+}
+
+void StateFleet::addToBucket(uint32_t instance, uint32_t state)
+{
+    instances[instance].state = state;
+    instances[instance].position = static_cast<uint32_t>(buckets[state].size());
+
+    buckets[state].push_back(instance);
+}
+
+void StateFleet::removeFromBucket(uint32_t instance)
+{
+    Instance &removed = instances[instance];
+
+    if (removed.state == noState)
+    {
+        return;
+    }
+
+    // The last instance of the bucket takes the place of the removed one.
+    vector<uint32_t> &bucket = buckets[removed.state];
+    uint32_t last = bucket.back();
+
+    bucket[removed.position] = last;
+    instances[last].position = removed.position;
+    bucket.pop_back();
+
+    removed.state = noState;
+}
+
+void StateFleet::enterState(uint32_t instance, size_t state)
+{
+    size_t compositeCount = definition->getCompositeCount();
+    size_t active = instances[instance].state != noState ? instances[instance].state : StateDefinition::noState;
+    size_t leaf = definition->enter(state, active, lastChild.data() + instance * compositeCount, lastLeaf.data() + instance * compositeCount);
+
+    if (leaf != active)
+    {
+        removeFromBucket(instance);
+        addToBucket(instance, static_cast<uint32_t>(leaf));
+    }
+}
+
+size_t StateFleet::run(bool transitionToo)
+{
+    // The tick boundary: the only place a newly published definition is picked up.
+    const StateDefinition *latest = domain->getDefinition();
+
+    if (latest != definition)
+    {
+        moveTo(latest);
+    }
+
+    const vector<StateDefinition::GlobalTransition> &globalTransitions = definition->getGlobalTransitions();
+    size_t stateRan = 0;
+
+    moves.clear();
+
+    for (size_t state = 0; state < buckets.size(); state++)
+    {
+        const vector<uint32_t> &bucket = buckets[state];
+
+        if (bucket.empty())
+        {
+            continue;
+        }
+
+        const StateDefinition::State &active = definition->getState(state);
+
+        // The transition functions take the name by value (like those of StateManager), so every call copies it,
+        // but nothing else does.
+        const string &activeName = active.stateName;
+
+        // What only depends on the state is worked out once for the whole bucket.
+        candidates.clear();
+
+        for (size_t s = 0; transitionToo && s < definition->size(); s++)
+        {
+            if (s != state && definition->canEnterFrom(s, state))
+            {
+                candidates.push_back(s);
+            }
+        }
+
+        for (size_t i = 0; i < bucket.size(); i++)
+        {
+            // The instance records further ahead, so their context pointers are there when those are prefetched.
+            if (i + 2 * prefetchDistance < bucket.size())
+            {
+                prefetch(&instances[bucket[i + 2 * prefetchDistance]]);
+            }
+
+            if (i + prefetchDistance < bucket.size())
+            {
+                prefetch(instances[bucket[i + prefetchDistance]].context);
+            }
+
+            currentContext = instances[bucket[i]].context;
+
+            if (active.stateFunction())
+            {
+                stateRan++;
+            }
+
+            if (!transitionToo)
+            {
+                continue;
+            }
+
+            size_t next = StateDefinition::noState;
+
+            for (size_t g = 0; g < globalTransitions.size() && next == StateDefinition::noState; g++)
+            {
+                if (!definition->isWithin(state, globalTransitions[g].toState) && globalTransitions[g].transitionToState(activeName))
+                {
+                    next = globalTransitions[g].toState;
+                }
+            }
+
+            for (size_t c = 0; c < candidates.size() && next == StateDefinition::noState; c++)
+            {
+                if (definition->getState(candidates[c]).transitionToState(activeName))
+                {
+                    next = candidates[c];
+                }
+            }
+
+            // Moving the instance now would change the bucket being ticked.
+            if (next != StateDefinition::noState)
+            {
+                Move move;
+                move.instance = bucket[i];
+                move.state = static_cast<uint32_t>(next);
+
+                moves.push_back(move);
+            }
+        }
+    }
+
+    currentContext = nullptr;
+
+    for (auto &move : moves)
+    {
+        enterState(move.instance, move.state);
+    }
+
+    return stateRan;
+}
+
+bool StateFleet::transition(size_t instance, const string &stateName)
+{
+    size_t state = definition->getStateIndex(stateName);
+
+    if (instance >= instances.size() || instances[instance].removed || state == StateDefinition::noState)
+    {
+        return false;
+    }
+
+    enterState(static_cast<uint32_t>(instance), state);
+
+    return true;
+}
+
+bool StateFleet::dispatchEvent(size_t instance, unsigned event)
+{
+    if (instance >= instances.size() || instances[instance].removed || instances[instance].state == noState)
+    {
+        return false;
+    }
+
+    size_t target = definition->eventTarget(instances[instance].state, event);
+
+    if (target == StateDefinition::noState)
+    {
+        return false;
+    }
+
+    enterState(static_cast<uint32_t>(instance), target);
+
+    return true;
+}
+
+string StateFleet::getActiveStateName(size_t instance) const
+{
+    if (instance >= instances.size() || instances[instance].state == noState)
+    {
+        return string();
+    }
+
+    return definition->getState(instances[instance].state).stateName;
+}
+
+size_t StateFleet::getInstanceCount(const string &stateName) const
+{
+    size_t state = definition->getStateIndex(stateName);
+
+    return state != StateDefinition::noState ? buckets[state].size() : 0;
+}
@@ -0,0 +1,180 @@
+/**
+ * @brief Many instances of one published definition, ticked state by state.
+ * @author Honzik Schenk
+ *
+ * StateFleet runs a large number of instances (ex: one per device or per
+ * session) from the definition of a StateDefinitionDomain. Every instance
+ * only has an active state, the history of its composite states and a
+ * context pointer. Ticking instances in index order calls a different state
+ * function almost every time, so the indirect calls are mispredicted and the
+ * code of every state is fetched again and again. Instead, the fleet keeps
+ * one bucket of instances per active state, updated as instances transition,
+ * and ticks bucket by bucket: the state function and the transition
+ * functions of a state run over all its instances in a row, while the
+ * contexts of the next instances are prefetched.
+ *
+ * The functions of a definition take no instance; while an instance is
+ * ticked, getContext() returns its context. Like StateMachine, the fleet
+ * moves to a newly published definition at the start of a tick.
+ */
+
+#ifndef STATEFLEET_HPP
+#define STATEFLEET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "StateDefinition.hpp"
+#include "StateDefinitionDomain.hpp"
+
+using namespace std;
+
+class StateFleet
+{
+public:
+    /**
+     * @brief How many instances ahead the contexts are prefetched while ticking a bucket.
+     */
+    static const size_t prefetchDistance = 4;
+
+    /**
+     * @brief Create an empty fleet running the current definition of a domain.
+     * @param domain The domain to take definitions from. It must outlive the fleet.
+     */
+    StateFleet(StateDefinitionDomain &domain);
+
+    ~StateFleet();
+
+    /**
+     * @brief Add an instance, starting in the initial state of the definition.
+     * @param context The context returned by getContext() while the instance is ticked.
+     * @return The index of the instance. Indexes of removed instances are reused.
+     */
+    size_t addInstance(void *context = nullptr);
+
+    /**
+     * @brief Remove an instance.
+     * @return True if the instance was removed, false if there is no such instance.
+     */
+    bool removeInstance(size_t instance);
+
+    /**
+     * @brief Tick every instance: run its active state, bucket by bucket, after moving to a newly published definition.
+     * @param transitionToo Whether to transition every instance to its next state after running it.
+     * @return The number of instances whose state function returned true.
+     *
+     * @note The transitions are applied once every instance ran, each as StateMachine::transition() would pick it.
+     * @warning The state and transition functions must not add, remove or transition instances.
+     */
+    size_t run(bool transitionToo = false);
+
+    /**
+     * @brief Transition an instance to a state.
+     * @return True if the instance and the state were found.
+     */
+    bool transition(size_t instance, const string &stateName);
+
+    /**
+     * @brief Dispatch an event to the active state of an instance.
+     * @return True if the event made the instance transition, false if it was dropped.
+     */
+    bool dispatchEvent(size_t instance, unsigned event);
+
+    /**
+     * @brief Get the name of the active state of an instance (empty if no state is active).
+     */
+    string getActiveStateName(size_t instance) const;
+
+    /**
+     * @brief Get the number of instances whose active state is a state.
+     */
+    size_t getInstanceCount(const string &stateName) const;
+
+    /**
+     * @brief Get the number of instances.
+     */
+    size_t size() const
+    {
+        return instanceCount;
+    }
+
+    /**
+     * @brief Get the context of the instance being ticked (nullptr outside of run()).
+     */
+    static void *getContext()
+    {
+        return currentContext;
+    }
+
+    template <typename T>
+    static T *getContext()
+    {
+        return static_cast<T *>(currentContext);
+    }
+
+    /**
+     * @brief Move to the current definition of the domain now instead of at the next tick.
+     * @return True if the fleet moved to a new definition.
+     */
+    bool update();
+
+private:
+    struct Instance
+    {
+        void *context;
+
+        // The active state (noState if no state is active).
+        uint32_t state;
+
+        // The position of the instance in the bucket of its state.
+        uint32_t position;
+
+        // Removed instances wait in freeInstances to be reused.
+        bool removed;
+    };
+
+    struct Move
+    {
+        uint32_t instance;
+        uint32_t state;
+    };
+
+    static const uint32_t noState = static_cast<uint32_t>(-1);
+
+    static thread_local void *currentContext;
+
+    StateDefinitionDomain *domain;
+    StateDefinitionDomain::ReaderSlot *reader;
+
+    const StateDefinition *definition;
+
+    vector<Instance> instances;
+    vector<size_t> freeInstances;
+    size_t instanceCount;
+
+    // The instances of every state, in no particular order.
+    vector<vector<uint32_t>> buckets;
+
+    // The history of every instance, getCompositeCount() entries per instance.
+    vector<size_t> lastChild;
+    vector<size_t> lastLeaf;
+
+    // Reused by every run(), so ticks do not allocate.
+    vector<Move> moves;
+    vector<size_t> candidates;
+
+    void moveTo(const StateDefinition *latest);
+
+    void enterState(uint32_t instance, size_t state);
+
+    void addToBucket(uint32_t instance, uint32_t state);
+
+    void removeFromBucket(uint32_t instance);
+
+    StateFleet(const StateFleet &) = delete;
+    StateFleet &operator=(const StateFleet &) = delete;
+};
+
+#endif // STATEFLEET_HPP
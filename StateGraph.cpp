@@ -0,0 +1,229 @@
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "StateGraph.hpp"
+
+using namespace std;
+
+namespace
+{
+    const uint16_t noHop16 = 0xFFFF;
+    const uint32_t noHop32 = 0xFFFFFFFF;
+
+    size_t lowestBit(uint64_t bits)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<size_t>(__builtin_ctzll(bits));
+#else
+        size_t bit = 0;
+
+        while (!(bits & 1))
+        {
+            bits >>= 1;
+            bit++;
+        }
+
+        return bit;
+#endif
+    }
+}
+
+const size_t StateGraph::noState;
+
+StateGraph::StateGraph()
+{
+    stateCount = 0;
+    words = 0;
+    fullTable = false;
+}
+
+void StateGraph::build(size_t stateCount, const vector<pair<size_t, size_t>> &edges, size_t fullTableLimit)
+{
+    this->stateCount = stateCount;
+    words = (stateCount + 63) / 64;
+
+    adjacency.assign(stateCount * words, 0);
+    reach.assign(stateCount * words, 0);
+    nextHopTable.clear();
+    nextHopCache.clear();
+    nextHopCache.resize(stateCount);
+
+    vector<size_t> inDegree(stateCount + 1, 0);
+
+    for (auto &edge : edges)
+    {
+        if (edge.first >= stateCount || edge.second >= stateCount)
+        {
+            continue;
+        }
+
+        uint64_t &word = adjacency[edge.first * words + edge.second / 64];
+        uint64_t bit = uint64_t(1) << (edge.second % 64);
+
+        if (!(word & bit))
+        {
+            word |= bit;
+            inDegree[edge.second]++;
+        }
+    }
+
+    predecessorStart.assign(stateCount + 1, 0);
+
+    for (size_t to = 0; to < stateCount; to++)
+    {
+        predecessorStart[to + 1] = predecessorStart[to] + inDegree[to];
+    }
+
+    predecessors.assign(predecessorStart[stateCount], 0);
+    vector<size_t> filled(predecessorStart.begin(), predecessorStart.end() - 1);
+
+    for (size_t from = 0; from < stateCount; from++)
+    {
+        for (size_t w = 0; w < words; w++)
+        {
+            for (uint64_t bits = adjacency[from * words + w]; bits != 0; bits &= bits - 1)
+            {
+                size_t to = w * 64 + lowestBit(bits);
+
+                predecessors[filled[to]++] = from;
+            }
+        }
+    }
+
+    // Bit-parallel breadth-first search: every level ORs in the successor rows of the whole frontier at once.
+    vector<uint64_t> frontier(words);
+    vector<uint64_t> next(words);
+
+    for (size_t from = 0; from < stateCount; from++)
+    {
+        uint64_t *row = &reach[from * words];
+
+        for (size_t w = 0; w < words; w++)
+        {
+            row[w] = adjacency[from * words + w];
+            frontier[w] = row[w];
+        }
+
+        bool grew = true;
+
+        while (grew)
+        {
+            next.assign(words, 0);
+
+            for (size_t w = 0; w < words; w++)
+            {
+                for (uint64_t bits = frontier[w]; bits != 0; bits &= bits - 1)
+                {
+                    const uint64_t *successors = &adjacency[(w * 64 + lowestBit(bits)) * words];
+
+                    for (size_t v = 0; v < words; v++)
+                    {
+                        next[v] |= successors[v];
+                    }
+                }
+            }
+
+            grew = false;
+
+            for (size_t w = 0; w < words; w++)
+            {
+                frontier[w] = next[w] & ~row[w];
+                row[w] |= frontier[w];
+                grew = grew || frontier[w] != 0;
+            }
+        }
+    }
+
+    if (fullTableLimit > noHop16)
+    {
+        fullTableLimit = noHop16;
+    }
+
+    fullTable = stateCount <= fullTableLimit;
+
+    if (!fullTable)
+    {
+        return;
+    }
+
+    // The table is stored row by row, so all next hops from the active state share cache lines.
+    nextHopTable.assign(stateCount * stateCount, noHop16);
+
+    for (size_t to = 0; to < stateCount; to++)
+    {
+        vector<uint32_t> column = nextHopsToward(to);
+
+        for (size_t from = 0; from < stateCount; from++)
+        {
+            if (column[from] != noHop32)
+            {
+                nextHopTable[from * stateCount + to] = static_cast<uint16_t>(column[from]);
+            }
+        }
+    }
+}
+
+vector<uint32_t> StateGraph::nextHopsToward(size_t to) const
+{
+    vector<uint32_t> column(stateCount, noHop32);
+    vector<bool> visited(stateCount, false);
+    vector<size_t> queue;
+    queue.reserve(stateCount);
+
+    visited[to] = true;
+    queue.push_back(to);
+
+    // Search backwards from the target: the first time a state is seen, the state it was seen from is its next hop.
+    for (size_t head = 0; head < queue.size(); head++)
+    {
+        size_t current = queue[head];
+
+        for (size_t i = predecessorStart[current]; i < predecessorStart[current + 1]; i++)
+        {
+            size_t from = predecessors[i];
+
+            if (visited[from])
+            {
+                continue;
+            }
+
+            visited[from] = true;
+            column[from] = static_cast<uint32_t>(current);
+            queue.push_back(from);
+        }
+    }
+
+    return column;
+}
+
+size_t StateGraph::nextHop(size_t from, size_t to)
+{
+    if (from >= stateCount || to >= stateCount || from == to)
+    {
+        return noState;
+    }
+
+    if (fullTable)
+    {
+        uint16_t hop = nextHopTable[from * stateCount + to];
+
+        return hop == noHop16 ? noState : hop;
+    }
+
+    vector<uint32_t> &cached = nextHopCache[to];
+
+    if (cached.empty())
+    {
+        if (!reachable(from, to))
+        {
+            return noState;
+        }
+
+        cached = nextHopsToward(to);
+    }
+
+    uint32_t hop = cached[from];
+
+    return hop == noHop32 ? noState : hop;
+}
@@ -0,0 +1,126 @@
+/**
+ * @brief Reachability and shortest-path analysis of a transition graph.
+ * @author Honzik Schenk
+ *
+ * StateGraph works on densely numbered states (0 to stateCount - 1). When it
+ * is built it computes the transitive closure as one bitset per state, using a
+ * bit-parallel breadth-first search, and (for graphs up to a size limit) a
+ * table with the next hop on a shortest path between every pair of states.
+ * Larger graphs compute the next hops toward a target lazily, the first time
+ * the target is asked for, and cache them. Every query is O(1) afterwards.
+ */
+
+#ifndef STATEGRAPH_HPP
+#define STATEGRAPH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+class StateGraph
+{
+public:
+    /**
+     * @brief Returned by nextHop() when there is no next hop.
+     */
+    static const size_t noState = static_cast<size_t>(-1);
+
+    StateGraph();
+
+    /**
+     * @brief Build the graph and precompute its analysis tables.
+     * @param stateCount The number of states.
+     * @param edges The transitions of the graph as (from, to) pairs.
+     * @param fullTableLimit The largest number of states for which the all-pairs next hop table is precomputed.
+     */
+    void build(size_t stateCount, const vector<pair<size_t, size_t>> &edges, size_t fullTableLimit = 1024);
+
+    /**
+     * @brief Get the number of states in the graph.
+     */
+    size_t size() const
+    {
+        return stateCount;
+    }
+
+    /**
+     * @brief Check if a state can be reached from another one.
+     * @param from The state to start from.
+     * @param to The state to reach.
+     * @return True if there is a path from from to to (every state reaches itself).
+     */
+    bool reachable(size_t from, size_t to) const
+    {
+        if (from >= stateCount || to >= stateCount)
+        {
+            return false;
+        }
+
+        return from == to || (reach[from * words + to / 64] >> (to % 64)) & 1;
+    }
+
+    /**
+     * @brief Check if there is a transition from one state to another.
+     */
+    bool hasEdge(size_t from, size_t to) const
+    {
+        if (from >= stateCount || to >= stateCount)
+        {
+            return false;
+        }
+
+        return (adjacency[from * words + to / 64] >> (to % 64)) & 1;
+    }
+
+    /**
+     * @brief Get the first state on a shortest path from one state to another.
+     * @param from The state to start from.
+     * @param to The state to reach.
+     * @return The state to transition to next, or noState if to cannot be reached or from is to.
+     *
+     * @note For graphs above the full table limit, the first query toward a target runs a breadth-first search.
+     */
+    size_t nextHop(size_t from, size_t to);
+
+    /**
+     * @brief Get the states reachable from a state.
+     * @param from The state to start from.
+     * @return One bit per state, 64 states per word.
+     */
+    const uint64_t *reachableFrom(size_t from) const
+    {
+        return &reach[from * words];
+    }
+
+    /**
+     * @brief Get the number of 64 bit words in every bitset row.
+     */
+    size_t rowWords() const
+    {
+        return words;
+    }
+
+private:
+    vector<uint32_t> nextHopsToward(size_t to) const;
+
+    size_t stateCount;
+    size_t words;
+
+    vector<uint64_t> adjacency;
+    vector<uint64_t> reach;
+
+    // Predecessors of every state, for searching backwards from a target.
+    vector<size_t> predecessorStart;
+    vector<size_t> predecessors;
+
+    bool fullTable;
+    vector<uint16_t> nextHopTable;
+
+    // Indexed by target, empty until the first query toward the target.
+    vector<vector<uint32_t>> nextHopCache;
+};
+
+#endif // STATEGRAPH_HPP
@@ -0,0 +1,115 @@
+#include <cstdint>
+
+#include "StateHistogram.hpp"
+
+using namespace std;
+
+const unsigned StateHistogram::subBucketBits;
+const unsigned StateHistogram::maxValueBits;
+const size_t StateHistogram::subBucketCount;
+const size_t StateHistogram::bucketCount;
+
+StateHistogram::StateHistogram()
+{
+    reset();
+}
+
+void StateHistogram::reset()
+{
+    for (size_t i = 0; i < bucketCount; i++)
+    {
+        counts[i] = 0;
+    }
+
+    totalCount = 0;
+    sum = 0;
+    minValue = UINT64_MAX;
+    maxValue = 0;
+}
+
+void StateHistogram::merge(const StateHistogram &other)
+{
+    for (size_t i = 0; i < bucketCount; i++)
+    {
+        counts[i] += other.counts[i];
+    }
+
+    totalCount += other.totalCount;
+    sum += other.sum;
+
+    if (other.minValue < minValue)
+    {
+        minValue = other.minValue;
+    }
+
+    if (other.maxValue > maxValue)
+    {
+        maxValue = other.maxValue;
+    }
+}
+
+uint64_t StateHistogram::bucketUpperBound(size_t index)
+{
+    if (index < 2 * subBucketCount)
+    {
+        return index;
+    }
+
+    size_t shift = index / subBucketCount - 1;
+    uint64_t subBucket = index % subBucketCount + subBucketCount;
+
+    return ((subBucket + 1) << shift) - 1;
+}
+
+uint64_t StateHistogram::percentile(double percentile) const
+{
+    if (totalCount == 0)
+    {
+        return 0;
+    }
+
+    if (percentile < 0.0)
+    {
+        percentile = 0.0;
+    }
+
+    if (percentile > 100.0)
+    {
+        percentile = 100.0;
+    }
+
+    // The rank of the value we are looking for, counting from 1.
+    uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(totalCount) + 0.5);
+
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < bucketCount; i++)
+    {
+        seen += counts[i];
+
+        if (seen >= rank)
+        {
+            // The last bucket also holds every value too large to be tracked precisely.
+            uint64_t value = i == bucketCount - 1 ? maxValue : bucketUpperBound(i);
+
+            if (value > maxValue)
+            {
+                value = maxValue;
+            }
+
+            if (value < minValue)
+            {
+                value = minValue;
+            }
+
+            return value;
+        }
+    }
+
+    return maxValue;
+}
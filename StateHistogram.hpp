@@ -0,0 +1,155 @@
+/**
+ * @brief A fixed-size, log-linear (HDR-style) histogram for state dwell times.
+ * @author Honzik Schenk
+ *
+ * StateHistogram splits every power of two into a fixed number of linear
+ * sub-buckets, so values are recorded with a bounded relative error (about 3%)
+ * in constant memory. Recording a value is a count-leading-zeros and an array
+ * increment. Histograms from different machines or threads can be merged and
+ * queried for percentiles (ex: "what is the p99 time spent in Grasping?").
+ */
+
+#ifndef STATEHISTOGRAM_HPP
+#define STATEHISTOGRAM_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+class StateHistogram
+{
+public:
+    /**
+     * @brief Every power of two is split into 2^subBucketBits linear sub-buckets.
+     */
+    static const unsigned subBucketBits = 5;
+
+    /**
+     * @brief Values at or above 2^maxValueBits are recorded in the last bucket.
+     *
+     * @note With nanosecond values this covers dwell times of up to about 78 hours.
+     */
+    static const unsigned maxValueBits = 48;
+
+    static const size_t subBucketCount = size_t(1) << subBucketBits;
+    static const size_t bucketCount = (maxValueBits - subBucketBits + 1) * subBucketCount;
+
+    StateHistogram();
+
+    /**
+     * @brief Record a value.
+     * @param value The value to record (ex: a dwell time in nanoseconds).
+     */
+    void record(uint64_t value)
+    {
+        counts[bucketIndex(value)]++;
+
+        totalCount++;
+        sum += value;
+
+        if (value < minValue)
+        {
+            minValue = value;
+        }
+
+        if (value > maxValue)
+        {
+            maxValue = value;
+        }
+    }
+
+    /**
+     * @brief Add all values recorded in another histogram to this one.
+     * @param other The histogram to merge.
+     */
+    void merge(const StateHistogram &other);
+
+    /**
+     * @brief Remove all recorded values.
+     */
+    void reset();
+
+    /**
+     * @brief Get the value below which a percentage of the recorded values fall.
+     * @param percentile The percentile to query, from 0 to 100 (ex: 99 for the p99).
+     * @return The highest value equivalent to the percentile, or 0 if nothing was recorded.
+     */
+    uint64_t percentile(double percentile) const;
+
+    /**
+     * @brief Get the number of recorded values.
+     */
+    uint64_t count() const
+    {
+        return totalCount;
+    }
+
+    /**
+     * @brief Get the smallest recorded value, or 0 if nothing was recorded.
+     */
+    uint64_t min() const
+    {
+        return totalCount == 0 ? 0 : minValue;
+    }
+
+    /**
+     * @brief Get the largest recorded value, or 0 if nothing was recorded.
+     */
+    uint64_t max() const
+    {
+        return maxValue;
+    }
+
+    /**
+     * @brief Get the mean of the recorded values, or 0 if nothing was recorded.
+     */
+    double mean() const
+    {
+        return totalCount == 0 ? 0.0 : static_cast<double>(sum) / static_cast<double>(totalCount);
+    }
+
+private:
+    static size_t bucketIndex(uint64_t value)
+    {
+        if (value < subBucketCount)
+        {
+            return static_cast<size_t>(value);
+        }
+
+        if (value >> maxValueBits)
+        {
+            return bucketCount - 1;
+        }
+
+        unsigned shift = highestBit(value) - subBucketBits;
+
+        return (shift + 1) * subBucketCount + static_cast<size_t>((value >> shift) - subBucketCount);
+    }
+
+    static uint64_t bucketUpperBound(size_t index);
+
+    static unsigned highestBit(uint64_t value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return 63 - static_cast<unsigned>(__builtin_clzll(value));
+#else
+        unsigned bit = 0;
+
+        while (value >>= 1)
+        {
+            bit++;
+        }
+
+        return bit;
+#endif
+    }
+
+    uint64_t counts[bucketCount];
+    uint64_t totalCount;
+    uint64_t sum;
+    uint64_t minValue;
+    uint64_t maxValue;
+};
+
+#endif // STATEHISTOGRAM_HPP
@@ -0,0 +1,191 @@
+#include <string>
+#include <vector>
+
+#include "StateMachine.hpp"
+
+using namespace std;
+
+StateMachine::StateMachine(StateDefinitionDomain &domain)
+{
+    this->domain = &domain;
+
+    definition = nullptr;
+    reader = domain.acquireReader(definition);
+
+    lastChild.assign(definition->getCompositeCount(), StateDefinition::noState);
+    lastLeaf.assign(definition->getCompositeCount(), StateDefinition::noState);
+
+    activeState = definition->getInitialState();
+}
+
+StateMachine::StateMachine(const StateMachine &machine)
+{
+    domain = machine.domain;
+
+    // The definition is immutable and the other machine keeps it alive until the new reader slot protects it.
+    definition = machine.definition;
+    reader = domain->acquireReader(definition);
+
+    activeState = machine.activeState;
+    lastChild = machine.lastChild;
+    lastLeaf = machine.lastLeaf;
+}
+
+StateMachine *StateMachine::clone() const
+{
+    return new StateMachine(*this);
+}
+
+StateMachine::~StateMachine()
+{
+    domain->releaseReader(reader);
+}
+
+bool StateMachine::update()
+{
+    const StateDefinition *latest = domain->getDefinition();
+
+    if (latest == definition)
+    {
+        return false;
+    }
+
+    moveTo(latest);
+
+    return true;
+}
+
+void StateMachine::moveTo(const StateDefinition *latest)
+{
+    StateDefinition::StateMapping mapping = latest->mapping != nullptr ? latest->mapping : StateDefinition::mapByName;
+    size_t mapped = mapping(*definition, activeState, *latest);
+
+    // The history of the old definition means nothing in the new one.
+    lastChild.assign(latest->getCompositeCount(), StateDefinition::noState);
+    lastLeaf.assign(latest->getCompositeCount(), StateDefinition::noState);
+
+    definition = latest;
+    activeState = StateDefinition::noState;
+
+    if (mapped < latest->size())
+    {
+        enterState(mapped);
+    }
+
+    // Only now is the old definition no longer used, so it may be reclaimed.
+    StateDefinitionDomain::advanceReader(reader, latest);
+}
+
+void StateMachine::enterState(size_t state)
+{
+    activeState = definition->enter(state, activeState, lastChild.data(), lastLeaf.data());
+}
+
+bool StateMachine::run()
+{
+    // The tick boundary: the only place a newly published definition is picked up.
+    const StateDefinition *latest = domain->getDefinition();
+
+    if (latest != definition)
+    {
+        moveTo(latest);
+    }
+
+    if (activeState == StateDefinition::noState)
+    {
+        return false;
+    }
+
+    return definition->getState(activeState).stateFunction();
+}
+
+bool StateMachine::run(bool transitionToo)
+{
+    bool stateRan = run();
+
+    if (transitionToo)
+    {
+        transition();
+    }
+
+    return stateRan;
+}
+
+bool StateMachine::transition()
+{
+    static const string noStateName;
+
+    // A reference into the definition: the transition functions get the only copies of the name.
+    const string &activeStateName = activeState == StateDefinition::noState ? noStateName : definition->getState(activeState).stateName;
+
+    for (auto &global : definition->getGlobalTransitions())
+    {
+        if (!definition->isWithin(activeState, global.toState) && global.transitionToState(activeStateName))
+        {
+            enterState(global.toState);
+            return true;
+        }
+    }
+
+    for (size_t s = 0; s < definition->size(); s++)
+    {
+        if (s == activeState || !definition->canEnterFrom(s, activeState))
+        {
+            continue;
+        }
+
+        if (definition->getState(s).transitionToState(activeStateName))
+        {
+            enterState(s);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool StateMachine::transition(string stateName)
+{
+    size_t state = definition->getStateIndex(stateName);
+
+    if (state == StateDefinition::noState)
+    {
+        return false;
+    }
+
+    enterState(state);
+
+    return true;
+}
+
+bool StateMachine::dispatchEvent(unsigned event)
+{
+    size_t target = definition->eventTarget(activeState, event);
+
+    if (target == StateDefinition::noState)
+    {
+        return false;
+    }
+
+    enterState(target);
+
+    return true;
+}
+
+string StateMachine::getActiveStateName()
+{
+    return activeState == StateDefinition::noState ? string() : definition->getState(activeState).stateName;
+}
+
+bool StateMachine::isInState(string stateName)
+{
+    for (size_t state = activeState; state != StateDefinition::noState; state = definition->getState(state).parent)
+    {
+        if (definition->getState(state).stateName == stateName)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
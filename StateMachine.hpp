@@ -0,0 +1,127 @@
+/**
+ * @brief A lightweight state machine instance running a published definition.
+ * @author Honzik Schenk
+ *
+ * StateMachine runs a StateDefinition compiled from a StateManager (see
+ * StateManager::compile()) and published in a StateDefinitionDomain. It only
+ * keeps the per-instance runtime (the active state and the history of its
+ * composite states), so many instances can share one definition. At the start
+ * of every tick it checks if a new definition was published and, if so, moves
+ * to it, mapping its active state; ticks never take a lock.
+ *
+ * The instrumentation of StateManager (metrics, histograms, hysteresis, edge
+ * triggers and deferred events) is not available on a StateMachine.
+ */
+
+#ifndef STATEMACHINE_HPP
+#define STATEMACHINE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "StateDefinition.hpp"
+#include "StateDefinitionDomain.hpp"
+
+using namespace std;
+
+class StateMachine
+{
+public:
+    /**
+     * @brief Create a machine running the current definition of a domain, starting in its initial state.
+     * @param domain The domain to take definitions from. It must outlive the machine.
+     */
+    StateMachine(StateDefinitionDomain &domain);
+
+    ~StateMachine();
+
+    /**
+     * @brief Create a machine sharing the definition of this one, in the same state and with the same history.
+     * @return The new machine, owned by the caller.
+     *
+     * @note Only the per-instance runtime is copied, so cloning costs the same no matter how many states there are
+     * (ex: a machine per incoming session, cloned from a configured prototype). Clone from the thread running this machine.
+     */
+    StateMachine *clone() const;
+
+    /**
+     * @brief Run the active state (a tick), after moving to a newly published definition if there is one.
+     * @return The return value of the state function, or false if no state is active.
+     */
+    bool run();
+
+    /**
+     * @brief Run the active state (a tick) and then transition to the next state if needed.
+     * @param transitionToo Whether to transition to the next state.
+     * @return The return value of the state function, or false if no state is active.
+     */
+    bool run(bool transitionToo);
+
+    /**
+     * @brief Transition to the first state whose transition function returns true, global transitions first.
+     * @return True if the machine transitioned to another state.
+     */
+    bool transition();
+
+    /**
+     * @brief Transition to a state.
+     * @param stateName The name of the state.
+     * @return True if the state was found.
+     */
+    bool transition(string stateName);
+
+    /**
+     * @brief Dispatch an event to the active state.
+     * @param event The id of the event.
+     * @return True if the event made the machine transition, false if it was dropped.
+     */
+    bool dispatchEvent(unsigned event);
+
+    /**
+     * @brief Get the name of the active state (empty if no state is active).
+     */
+    string getActiveStateName();
+
+    /**
+     * @brief Check if a state is active, either as the active state or as one of its composite states.
+     */
+    bool isInState(string stateName);
+
+    /**
+     * @brief Get the generation of the definition the machine is running.
+     */
+    uint64_t getGeneration() const
+    {
+        return definition->getGeneration();
+    }
+
+    /**
+     * @brief Move to the current definition of the domain now instead of at the next tick.
+     * @return True if the machine moved to a new definition.
+     */
+    bool update();
+
+private:
+    StateDefinitionDomain *domain;
+    StateDefinitionDomain::ReaderSlot *reader;
+
+    const StateDefinition *definition;
+
+    size_t activeState;
+
+    // Indexed by StateDefinition::State::composite.
+    vector<size_t> lastChild;
+    vector<size_t> lastLeaf;
+
+    void moveTo(const StateDefinition *latest);
+
+    void enterState(size_t state);
+
+    StateMachine(const StateMachine &machine);
+
+    StateMachine &operator=(const StateMachine &) = delete;
+};
+
+#endif // STATEMACHINE_HPP
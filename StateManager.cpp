@@ -1,20 +1,108 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <iostream>
+#include <sstream>
 
 #include "StateManager.hpp"
 
+#ifndef STATEMANAGER_INLINE_DISPATCH
+#include "StateManagerInline.hpp"
+#endif
+
 using namespace std;
 
-StateManager::StateManager() : activeState(dummyState)
+namespace
+{
+    // Move the entries of a table indexed by state id to their new ids, dropping the entries of removed states.
+    template <typename T>
+    void remapById(vector<T> &table, const vector<size_t> &newIdById, size_t newIdCount)
+    {
+        if (table.empty())
+        {
+            return;
+        }
+
+        // Kept states without an entry (the table was never grown to their id) get a default constructed one.
+        vector<T> remapped(newIdCount);
+
+        for (size_t id = 0; id < table.size() && id < newIdById.size(); id++)
+        {
+            if (newIdById[id] != StateGraph::noState)
+            {
+                remapped[newIdById[id]] = table[id];
+            }
+        }
+
+        table.swap(remapped);
+    }
+}
+
+StateManager::StateManager() : activeState(currentState)
 {
     dummyState.stateName = "dummyState";
+    dummyState.id = 0;
     dummyState.stateFunction = dummyStateFunction;
     dummyState.transitionToState = dummyTransitionToState;
 
     activeState = dummyState;
 
     states = vector<State>();
+
+    nextStateId = 1;
+    stateEnteredAt = chrono::steady_clock::now();
+    timedTransitions = false;
+
+    metrics = nullptr;
+    ticksMetric = StateMetrics::invalidMetric;
+    queueDepthMetrics[StateEventQueue::Normal] = StateMetrics::invalidMetric;
+    queueDepthMetrics[StateEventQueue::High] = StateMetrics::invalidMetric;
+    queueDroppedMetric = StateMetrics::invalidMetric;
+    queueCoalescedMetric = StateMetrics::invalidMetric;
+    unregisteredTransitionsMetric = StateMetrics::invalidMetric;
+    transitionMetricsRegistered = true;
+
+    dwellHistogramsEnabled = false;
+    perfCountersAtEntryValid = false;
+
+    transitionCount = 0;
+
+    oscillationWindow = chrono::nanoseconds::zero();
+    oscillationMaxTransitions = 0;
+    oscillationHandler = nullptr;
+
+    graphFinalized = false;
+
+    compositeCount = 0;
+
+    deferredHead = 0;
+    deferredCount = 0;
+    droppedDeferredEvents = 0;
+    reofferingDeferred = false;
+    deferredEvents = vector<unsigned>(16);
+
+    eventQueue = nullptr;
+    queueDroppedSeen = 0;
+    queueCoalescedSeen = 0;
+
+    activeLocal = nullptr;
+    activeLocalType = nullptr;
+    activeLocalDestroy = nullptr;
+}
+
+StateManager::~StateManager()
+{
+    releaseStateLocal();
+
+    for (auto &trigger : edgeTriggers)
+    {
+        if (trigger.blackboard != nullptr)
+        {
+            detachBlackboard(trigger.blackboard);
+        }
+    }
 }
 
 StateManager::State *StateManager::getStateByName(const string stateName)
@@ -40,44 +128,181 @@ bool StateManager::dummyTransitionToState(string activeState)
     return false;
 }
 
-bool StateManager::run()
+const StateManager::StateMetricIds &StateManager::stateMetricIds(const State &state)
 {
-    return activeState.stateFunction();
+    if (stateMetrics.size() <= state.id)
+    {
+        stateMetrics.resize(state.id + 1);
+    }
+
+    StateMetricIds &ids = stateMetrics[state.id];
+
+    if (!ids.registered)
+    {
+        string labels = StateMetrics::label("machine", metricsMachineName) + "," + StateMetrics::label("state", state.stateName);
+
+        ids.guardCalls = metrics->addCounter("statemanager_guard_calls_total", "Number of times the transition function of a state was called.", labels);
+        ids.guardTrue = metrics->addCounter("statemanager_guard_true_total", "Number of times the transition function of a state returned true.", labels);
+        ids.timeInState = metrics->addCounter("statemanager_state_time_nanoseconds_total", "Total time spent in a state, recorded when the state is left.", labels);
+        ids.registered = true;
+    }
+
+    return ids;
 }
 
-bool StateManager::run(bool transitionToo)
+void StateManager::enterState(State &target)
 {
-    bool stateRan = activeState.stateFunction();
+    // Entering a composite state enters one of its leaf states instead.
+    State &state = withHierarchy && compositeCount > 0 ? resolveEntry(target) : target;
+
+    if (withTiming && timedTransitions)
+    {
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        uint64_t dwellTime = chrono::duration_cast<chrono::nanoseconds>(now - stateEnteredAt).count();
+
+        if (withMetrics && metrics != nullptr)
+        {
+            metrics->increment(stateMetricIds(activeState).timeInState, dwellTime);
+
+            StateMetrics::MetricId transitionMetric = transitionMetricId(activeState, state);
+
+            metrics->increment(transitionMetric != StateMetrics::invalidMetric ? transitionMetric : unregisteredTransitionsMetric);
+        }
+
+        if (withDwellHistograms && dwellHistogramsEnabled)
+        {
+            dwellHistograms[activeState.id].record(dwellTime);
+        }
+
+        if (withOscillationDetection && oscillationMaxTransitions > 0)
+        {
+            detectOscillation(activeState, state, now);
+        }
+
+        stateEnteredAt = now;
+    }
+
+    transitionCount++;
+
+    if (withPerfCounters && perfCounters)
+    {
+        StatePerfCounters::Sample sample;
+        bool readSample = perfCounters->read(sample);
+
+        // A failed read is all zeros: skip it, and do not attribute anything until there are two good reads in a row.
+        if (readSample && perfCountersAtEntryValid)
+        {
+            StatePerfCounters::Sample &total = perfCountersPerState[activeState.id];
+            total.cycles += sample.cycles - perfCountersAtEntry.cycles;
+            total.instructions += sample.instructions - perfCountersAtEntry.instructions;
+            total.cacheMisses += sample.cacheMisses - perfCountersAtEntry.cacheMisses;
+            total.branchMisses += sample.branchMisses - perfCountersAtEntry.branchMisses;
+        }
 
-    if (!transitionToo)
+        perfCountersAtEntry = sample;
+        perfCountersAtEntryValid = readSample;
+    }
+
+    if (withHierarchy && compositeCount > 0)
     {
-        return stateRan;
+        recordHistory(activeState.id);
     }
 
-    for (auto &s : states)
+    if (withStateLocal && stateArena.capacity() > 0)
+    {
+        releaseStateLocal();
+        acquireStateLocal(state.id);
+    }
+
+    activeState = state;
+
+    if (withDeferral && deferredCount > 0 && !reofferingDeferred)
+    {
+        reofferDeferredEvents();
+    }
+}
+
+bool StateManager::debounce(const State &state, bool wantsToBecomeActive)
+{
+    for (auto &h : edgeHysteresis[state.id])
     {
-        if (activeState != s && s.transitionToState(activeState.stateName))
+        if (h.fromId != activeState.id)
+        {
+            continue;
+        }
+
+        // Consecutive evaluations only count while the source state stays active.
+        if (h.countedAtTransition != transitionCount)
+        {
+            h.countedAtTransition = transitionCount;
+            h.trueCount = 0;
+        }
+
+        if (!wantsToBecomeActive)
+        {
+            h.trueCount = 0;
+            return false;
+        }
+
+        if (h.trueCount < h.consecutiveTrue)
+        {
+            h.trueCount++;
+        }
+
+        if (h.trueCount < h.consecutiveTrue)
         {
-            activeState = s;
-            return stateRan;
+            return false;
         }
+
+        return h.minDwell <= chrono::nanoseconds::zero() || chrono::steady_clock::now() - stateEnteredAt >= h.minDwell;
     }
 
-    return stateRan;
+    return wantsToBecomeActive;
 }
 
-bool StateManager::transition()
+void StateManager::updateTransitionTiming()
 {
-    for (auto &s : states)
+    bool timed = metrics != nullptr || dwellHistogramsEnabled || oscillationMaxTransitions > 0;
+
+    for (size_t to = 0; to < edgeHysteresis.size() && !timed; to++)
     {
-        if (activeState != s && s.transitionToState(activeState.stateName))
+        for (auto &h : edgeHysteresis[to])
         {
-            activeState = s;
-            return true;
+            timed = timed || h.minDwell > chrono::nanoseconds::zero();
         }
     }
 
-    return false;
+    // The active state was entered while nothing read the clock, so its dwell starts now.
+    if (timed && !timedTransitions)
+    {
+        stateEnteredAt = chrono::steady_clock::now();
+    }
+
+    timedTransitions = timed;
+}
+
+void StateManager::detectOscillation(const State &from, const State &to, chrono::steady_clock::time_point now)
+{
+    EdgeFlips &flips = edgeFlips[make_pair(from.id, to.id)];
+
+    if (flips.transitions == 0 || now - flips.windowStart >= oscillationWindow)
+    {
+        flips.windowStart = now;
+        flips.transitions = 0;
+        flips.reported = false;
+    }
+
+    flips.transitions++;
+
+    if (flips.transitions >= oscillationMaxTransitions && !flips.reported)
+    {
+        flips.reported = true;
+
+        if (oscillationHandler != nullptr)
+        {
+            oscillationHandler(from.stateName, to.stateName, flips.transitions);
+        }
+    }
 }
 
 bool StateManager::transition(string stateName)
@@ -89,7 +314,7 @@ bool StateManager::transition(string stateName)
         return false;
     }
 
-    activeState = *state;
+    enterState(*state);
 
     return true;
 }
@@ -105,9 +330,35 @@ bool StateManager::addState(string stateName)
 
     State state;
     state.stateName = stateName;
+    state.id = nextStateId++;
+    state.stateFunction = dummyStateFunction;
+    state.transitionToState = dummyTransitionToState;
+
+    graphFinalized = false;
 
     states.push_back(state);
 
+    stateIndexById.resize(nextStateId, StateGraph::noState);
+    stateIndexById[state.id] = states.size() - 1;
+
+    hierarchy.resize(nextStateId);
+
+    if (dwellHistogramsEnabled)
+    {
+        dwellHistograms.resize(nextStateId);
+    }
+
+    if (perfCounters)
+    {
+        perfCountersPerState.resize(nextStateId);
+    }
+
+    // Registered now rather than by the first tick in the state.
+    if (metrics != nullptr)
+    {
+        stateMetricIds(states.back());
+    }
+
     return true;
 }
 
@@ -122,9 +373,59 @@ bool StateManager::removeState(string stateName)
 
     if (activeState.stateName == stateName)
     {
+        releaseStateLocal();
+
         activeState = dummyState;
     }
 
+    if (state->id < stateLocals.size())
+    {
+        stateLocals[state->id] = StateLocal();
+    }
+
+    if (state->id < edgeHysteresis.size())
+    {
+        edgeHysteresis[state->id].clear();
+    }
+
+    if (state->id < declaredSources.size())
+    {
+        declaredSources[state->id].clear();
+    }
+
+    for (size_t trigger = 0; trigger < edgeTriggers.size(); trigger++)
+    {
+        if (edgeTriggers[trigger].fromId == state->id || edgeTriggers[trigger].toId == state->id)
+        {
+            dropEdgeTrigger(trigger);
+        }
+    }
+
+    detachFromHierarchy(state->id);
+
+    if (state->id < eventTransitions.size())
+    {
+        eventTransitions[state->id].clear();
+    }
+
+    for (auto &transitions : eventTransitions)
+    {
+        for (auto &t : transitions)
+        {
+            t.toId = t.toId == state->id ? StateGraph::noState : t.toId;
+        }
+    }
+
+    for (size_t i = globalTransitions.size(); i > 0; i--)
+    {
+        if (globalTransitions[i - 1].toId == state->id)
+        {
+            globalTransitions.erase(globalTransitions.begin() + (i - 1));
+        }
+    }
+
+    graphFinalized = false;
+
     states.erase(find(states.begin(), states.end(), *state));
 
     if (states.size() == 0)
@@ -134,6 +435,9 @@ bool StateManager::removeState(string stateName)
         states.push_back(dummyState);
     }
 
+    indexStates();
+    updateTransitionTiming();
+
     return true;
 }
 
@@ -162,6 +466,8 @@ bool StateManager::setTransitionToState(string stateName, bool (*transitionToSta
 
     state->transitionToState = transitionToState;
 
+    graphFinalized = false;
+
     return true;
 }
 
@@ -169,3 +475,1752 @@ string StateManager::getActiveStateName()
 {
     return activeState.stateName;
 }
+
+bool StateManager::setMetrics(StateMetrics *metrics, string machineName)
+{
+    if (!withMetrics && metrics != nullptr)
+    {
+        return false;
+    }
+
+    this->metrics = metrics;
+
+    metricsMachineName = machineName;
+    ticksMetric = StateMetrics::invalidMetric;
+    queueDepthMetrics[StateEventQueue::Normal] = StateMetrics::invalidMetric;
+    queueDepthMetrics[StateEventQueue::High] = StateMetrics::invalidMetric;
+    queueDroppedMetric = StateMetrics::invalidMetric;
+    queueCoalescedMetric = StateMetrics::invalidMetric;
+    unregisteredTransitionsMetric = StateMetrics::invalidMetric;
+    stateMetrics.clear();
+    transitionMetrics.clear();
+    updateTransitionTiming();
+
+    if (metrics == nullptr)
+    {
+        return true;
+    }
+
+    ticksMetric = metrics->addCounter("statemanager_ticks_total", "Number of times the active state was run.", StateMetrics::label("machine", machineName));
+
+    for (int lane = StateEventQueue::Normal; lane <= StateEventQueue::High; lane++)
+    {
+        string labels = StateMetrics::label("machine", machineName) + "," + StateMetrics::label("lane", lane == StateEventQueue::High ? "high" : "normal");
+
+        queueDepthMetrics[lane] = metrics->addGauge("statemanager_queue_depth", "Number of events waiting in the event queue when it was last processed.", labels);
+    }
+
+    queueDroppedMetric = metrics->addCounter("statemanager_queue_dropped_total", "Number of events dropped because the event queue was full.", StateMetrics::label("machine", machineName));
+    queueCoalescedMetric = metrics->addCounter("statemanager_queue_coalesced_total", "Number of events coalesced into a pending event.", StateMetrics::label("machine", machineName));
+    unregisteredTransitionsMetric = metrics->addCounter("statemanager_transitions_unregistered_total", "Number of transitions whose counter did not fit in the registry.", StateMetrics::label("machine", machineName));
+
+    bool registered = ticksMetric != StateMetrics::invalidMetric && queueDepthMetrics[StateEventQueue::High] != StateMetrics::invalidMetric && unregisteredTransitionsMetric != StateMetrics::invalidMetric && stateMetricIds(activeState).timeInState != StateMetrics::invalidMetric;
+
+    for (auto &s : states)
+    {
+        registered = stateMetricIds(s).timeInState != StateMetrics::invalidMetric && registered;
+    }
+
+    // Registers the counters of the declared transitions.
+    finalize();
+
+    return transitionMetricsRegistered && registered;
+}
+
+void StateManager::setDwellHistograms(bool enabled)
+{
+    if (!withDwellHistograms)
+    {
+        return;
+    }
+
+    if (enabled == dwellHistogramsEnabled)
+    {
+        return;
+    }
+
+    dwellHistogramsEnabled = enabled;
+
+    // Allocate a histogram for every state id up front so recording never allocates.
+    dwellHistograms = enabled ? vector<StateHistogram>(nextStateId) : vector<StateHistogram>();
+
+    updateTransitionTiming();
+}
+
+const StateHistogram *StateManager::getDwellHistogram(string stateName)
+{
+    State *state = getStateByName(stateName);
+
+    if (state == nullptr || !dwellHistogramsEnabled)
+    {
+        return nullptr;
+    }
+
+    return &dwellHistograms[state->id];
+}
+
+bool StateManager::setPerfCounters(bool enabled)
+{
+    if (!withPerfCounters && enabled)
+    {
+        return false;
+    }
+
+    if (!enabled)
+    {
+        perfCounters.reset();
+        perfCountersPerState.clear();
+
+        return true;
+    }
+
+    if (perfCounters)
+    {
+        return true;
+    }
+
+    unique_ptr<StatePerfCounters> counters(new StatePerfCounters());
+
+    if (!counters->available())
+    {
+        return false;
+    }
+
+    perfCounters = move(counters);
+    perfCountersAtEntryValid = perfCounters->read(perfCountersAtEntry);
+    perfCountersPerState = vector<StatePerfCounters::Sample>(nextStateId);
+
+    return true;
+}
+
+bool StateManager::getPerfCounters(string stateName, StatePerfCounters::Sample &sample)
+{
+    State *state = getStateByName(stateName);
+
+    if (state == nullptr || !perfCounters)
+    {
+        return false;
+    }
+
+    sample = perfCountersPerState[state->id];
+
+    return true;
+}
+
+bool StateManager::setTransitionHysteresis(string fromState, string toState, chrono::nanoseconds minDwell, unsigned consecutiveTrue)
+{
+    if (!withHysteresis)
+    {
+        return false;
+    }
+
+    State *from = getStateByName(fromState);
+    State *to = getStateByName(toState);
+
+    if (from == nullptr || to == nullptr)
+    {
+        return false;
+    }
+
+    if (edgeHysteresis.size() <= to->id)
+    {
+        edgeHysteresis.resize(to->id + 1);
+    }
+
+    vector<EdgeHysteresis> &edges = edgeHysteresis[to->id];
+
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        if (edges[i].fromId == from->id)
+        {
+            edges.erase(edges.begin() + i);
+            break;
+        }
+    }
+
+    if (minDwell <= chrono::nanoseconds::zero() && consecutiveTrue <= 1)
+    {
+        updateTransitionTiming();
+
+        return true;
+    }
+
+    EdgeHysteresis h;
+    h.fromId = from->id;
+    h.minDwell = minDwell;
+    h.consecutiveTrue = consecutiveTrue;
+    h.trueCount = 0;
+    h.countedAtTransition = transitionCount;
+
+    edges.push_back(h);
+    updateTransitionTiming();
+
+    return true;
+}
+
+void StateManager::setOscillationDetection(chrono::nanoseconds window, unsigned maxTransitions, void (*onOscillation)(const string &fromState, const string &toState, unsigned transitions))
+{
+    if (!withOscillationDetection)
+    {
+        return;
+    }
+
+    oscillationWindow = window;
+    oscillationMaxTransitions = window > chrono::nanoseconds::zero() ? maxTransitions : 0;
+    oscillationHandler = onOscillation;
+
+    edgeFlips.clear();
+    updateTransitionTiming();
+}
+
+vector<StateManager::Oscillation> StateManager::getOscillatingEdges()
+{
+    vector<Oscillation> oscillating;
+
+    if (oscillationMaxTransitions == 0)
+    {
+        return oscillating;
+    }
+
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+    for (auto &edge : edgeFlips)
+    {
+        if (!edge.second.reported || now - edge.second.windowStart >= 2 * oscillationWindow)
+        {
+            continue;
+        }
+
+        Oscillation o;
+        o.fromState = stateNameById(edge.first.first);
+        o.toState = stateNameById(edge.first.second);
+        o.transitions = edge.second.transitions;
+        o.transitionsPerSecond = edge.second.transitions / chrono::duration<double>(oscillationWindow).count();
+
+        oscillating.push_back(o);
+    }
+
+    return oscillating;
+}
+
+StateManager::State *StateManager::getStateById(size_t id)
+{
+    if (id >= stateIndexById.size() || stateIndexById[id] == StateGraph::noState)
+    {
+        return nullptr;
+    }
+
+    return &states[stateIndexById[id]];
+}
+
+void StateManager::indexStates()
+{
+    stateIndexById.assign(nextStateId, StateGraph::noState);
+
+    for (size_t i = 0; i < states.size(); i++)
+    {
+        if (states[i].id < nextStateId)
+        {
+            stateIndexById[states[i].id] = i;
+        }
+    }
+}
+
+string StateManager::stateNameById(size_t id)
+{
+    State *state = getStateById(id);
+
+    if (state != nullptr)
+    {
+        return state->stateName;
+    }
+
+    return id == activeState.id ? activeState.stateName : string();
+}
+
+bool StateManager::addEdgeTrigger(string fromState, string toState, StateBlackboard *blackboard, string inputName)
+{
+    if (!withEdgeTriggers)
+    {
+        return false;
+    }
+
+    State *from = getStateByName(fromState);
+    State *to = getStateByName(toState);
+
+    if (from == nullptr || to == nullptr || blackboard == nullptr)
+    {
+        return false;
+    }
+
+    EdgeTrigger trigger;
+    trigger.fromId = from->id;
+    trigger.toId = to->id;
+    trigger.blackboard = blackboard;
+
+    edgeTriggers.push_back(trigger);
+    triggerPending.push_back(false);
+
+    // Reserve room for every trigger being pending at once, so notifications never allocate.
+    pendingTriggers.reserve(edgeTriggers.size());
+
+    blackboard->subscribe(blackboard->addInput(inputName), this, edgeTriggers.size() - 1);
+
+    graphFinalized = false;
+
+    return true;
+}
+
+void StateManager::notifyEdgeTrigger(size_t trigger)
+{
+    if (triggerPending[trigger])
+    {
+        return;
+    }
+
+    triggerPending[trigger] = true;
+    pendingTriggers.push_back(trigger);
+}
+
+void StateManager::detachBlackboard(StateBlackboard *blackboard)
+{
+    blackboard->unsubscribe(this);
+
+    for (size_t i = 0; i < edgeTriggers.size(); i++)
+    {
+        if (edgeTriggers[i].blackboard == blackboard)
+        {
+            edgeTriggers[i].blackboard = nullptr;
+        }
+    }
+
+    graphFinalized = false;
+}
+
+void StateManager::dropEdgeTrigger(size_t trigger)
+{
+    EdgeTrigger &dropped = edgeTriggers[trigger];
+
+    if (dropped.blackboard != nullptr)
+    {
+        dropped.blackboard->unsubscribe(this, trigger);
+    }
+
+    dropped.fromId = StateGraph::noState;
+    dropped.toId = StateGraph::noState;
+    dropped.blackboard = nullptr;
+
+    graphFinalized = false;
+}
+
+bool StateManager::takeEdgeTrigger()
+{
+    State *target = nullptr;
+
+    // Rising edges fire once: every pending trigger is consumed, whether it matches the active state or not.
+    for (size_t trigger : pendingTriggers)
+    {
+        triggerPending[trigger] = false;
+
+        if (target == nullptr && edgeTriggers[trigger].fromId == activeState.id)
+        {
+            target = getStateById(edgeTriggers[trigger].toId);
+        }
+    }
+
+    pendingTriggers.clear();
+
+    if (target == nullptr)
+    {
+        return false;
+    }
+
+    enterState(*target);
+
+    return true;
+}
+
+bool StateManager::isDeclaredSource(const State &state, size_t fromId)
+{
+    for (size_t source : declaredSources[state.id])
+    {
+        if (source == fromId)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool StateManager::addTransition(string fromState, string toState)
+{
+    if (!withDeclaredTransitions)
+    {
+        return false;
+    }
+
+    State *from = getStateByName(fromState);
+    State *to = getStateByName(toState);
+
+    if (from == nullptr || to == nullptr)
+    {
+        return false;
+    }
+
+    if (declaredSources.size() <= to->id)
+    {
+        declaredSources.resize(to->id + 1);
+    }
+
+    if (!isDeclaredSource(*to, from->id))
+    {
+        declaredSources[to->id].push_back(from->id);
+    }
+
+    graphFinalized = false;
+
+    return true;
+}
+
+void StateManager::finalize()
+{
+    graphIndexById.assign(nextStateId, StateGraph::noState);
+    graphIndexByName.clear();
+
+    for (size_t i = 0; i < states.size(); i++)
+    {
+        graphIndexById[states[i].id] = i;
+        graphIndexByName[states[i].stateName] = i;
+    }
+
+    vector<pair<size_t, size_t>> edges;
+    vector<pair<size_t, size_t>> anywhereEdges;
+
+    for (size_t to = 0; to < states.size(); to++)
+    {
+        const State &s = states[to];
+
+        if (s.id < declaredSources.size() && !declaredSources[s.id].empty())
+        {
+            for (size_t source : declaredSources[s.id])
+            {
+                if (graphIndexById[source] != StateGraph::noState)
+                {
+                    edges.push_back(make_pair(graphIndexById[source], to));
+                }
+            }
+        }
+        else if (canTransitionToFromAnywhere(s))
+        {
+            for (size_t from = 0; from < states.size(); from++)
+            {
+                if (from != to)
+                {
+                    anywhereEdges.push_back(make_pair(from, to));
+                }
+            }
+        }
+    }
+
+    // Entering a composite state can end up in any of its children (through its initial state or its history).
+    for (size_t i = 0; i < states.size(); i++)
+    {
+        size_t parent = hierarchy[states[i].id].parent;
+
+        if (parent != StateGraph::noState && graphIndexOf(parent) != StateGraph::noState)
+        {
+            edges.push_back(make_pair(graphIndexOf(parent), i));
+        }
+    }
+
+    for (auto &global : globalTransitions)
+    {
+        for (size_t from = 0; from < states.size(); from++)
+        {
+            if (from != graphIndexOf(global.toId))
+            {
+                anywhereEdges.push_back(make_pair(from, graphIndexOf(global.toId)));
+            }
+        }
+    }
+
+    for (size_t from = 0; from < eventTransitions.size(); from++)
+    {
+        for (auto &t : eventTransitions[from])
+        {
+            if (graphIndexOf(from) != StateGraph::noState && graphIndexOf(t.toId) != StateGraph::noState)
+            {
+                edges.push_back(make_pair(graphIndexOf(from), graphIndexOf(t.toId)));
+            }
+        }
+    }
+
+    for (auto &trigger : edgeTriggers)
+    {
+        if (trigger.blackboard != nullptr && graphIndexOf(trigger.fromId) != StateGraph::noState && graphIndexOf(trigger.toId) != StateGraph::noState)
+        {
+            edges.push_back(make_pair(graphIndexOf(trigger.fromId), graphIndexOf(trigger.toId)));
+        }
+    }
+
+    // Edges from every state are only registered once taken, there are too many of them.
+    transitionMetricsRegistered = metrics == nullptr || registerTransitionMetrics(edges);
+
+    edges.insert(edges.end(), anywhereEdges.begin(), anywhereEdges.end());
+    graph.build(states.size(), edges);
+
+    graphFinalized = true;
+}
+
+bool StateManager::registerTransitionMetrics(const vector<pair<size_t, size_t>> &edges)
+{
+    bool registered = true;
+
+    for (auto &edge : edges)
+    {
+        registered = transitionMetricId(states[edge.first], states[edge.second]) != StateMetrics::invalidMetric && registered;
+    }
+
+    return registered;
+}
+
+StateMetrics::MetricId StateManager::transitionMetricId(const State &from, const State &to)
+{
+    if (transitionMetrics.size() <= from.id)
+    {
+        transitionMetrics.resize(nextStateId);
+    }
+
+    vector<TransitionMetric> &registered = transitionMetrics[from.id];
+
+    for (auto &edge : registered)
+    {
+        if (edge.toId == to.id)
+        {
+            return edge.id;
+        }
+    }
+
+    string labels = StateMetrics::label("machine", metricsMachineName) + "," + StateMetrics::label("from", from.stateName) + "," + StateMetrics::label("to", to.stateName);
+
+    TransitionMetric edge;
+    edge.toId = to.id;
+    edge.id = metrics->addCounter("statemanager_transitions_total", "Number of transitions taken between two states.", labels);
+
+    registered.push_back(edge);
+
+    return edge.id;
+}
+
+size_t StateManager::graphIndexOf(size_t id)
+{
+    return id < graphIndexById.size() ? graphIndexById[id] : StateGraph::noState;
+}
+
+bool StateManager::isReachable(string fromState, string toState)
+{
+    if (!graphFinalized)
+    {
+        finalize();
+    }
+
+    unordered_map<string, size_t>::iterator from = graphIndexByName.find(fromState);
+    unordered_map<string, size_t>::iterator to = graphIndexByName.find(toState);
+
+    if (from == graphIndexByName.end() || to == graphIndexByName.end())
+    {
+        return false;
+    }
+
+    return graph.reachable(from->second, to->second);
+}
+
+string StateManager::nextHopToward(string targetState)
+{
+    if (!graphFinalized)
+    {
+        finalize();
+    }
+
+    unordered_map<string, size_t>::iterator target = graphIndexByName.find(targetState);
+
+    if (target == graphIndexByName.end())
+    {
+        return string();
+    }
+
+    size_t hop = graph.nextHop(graphIndexOf(activeState.id), target->second);
+
+    return hop == StateGraph::noState ? string() : states[hop].stateName;
+}
+
+vector<string> StateManager::pathToward(string targetState)
+{
+    vector<string> path;
+
+    if (!graphFinalized)
+    {
+        finalize();
+    }
+
+    unordered_map<string, size_t>::iterator target = graphIndexByName.find(targetState);
+
+    if (target == graphIndexByName.end())
+    {
+        return path;
+    }
+
+    size_t current = graphIndexOf(activeState.id);
+
+    while (current != target->second)
+    {
+        current = graph.nextHop(current, target->second);
+
+        if (current == StateGraph::noState)
+        {
+            return vector<string>();
+        }
+
+        path.push_back(states[current].stateName);
+    }
+
+    return path;
+}
+
+bool StateManager::canTransitionToFromAnywhere(const State &state)
+{
+    if (state.transitionToState == nullptr || state.transitionToState == dummyTransitionToState)
+    {
+        return false;
+    }
+
+    return state.id >= declaredSources.size() || declaredSources[state.id].empty();
+}
+
+StateManager::PruneReport StateManager::prune(vector<string> roots)
+{
+    PruneReport report;
+    report.statesBefore = states.size();
+    report.transitionsBefore = 0;
+    report.transitionsAfter = 0;
+
+    finalize();
+
+    for (auto &sources : declaredSources)
+    {
+        report.transitionsBefore += sources.size();
+    }
+
+    for (auto &trigger : edgeTriggers)
+    {
+        report.transitionsBefore += trigger.blackboard != nullptr ? 1 : 0;
+    }
+
+    for (auto &transitions : eventTransitions)
+    {
+        report.transitionsBefore += transitions.size();
+    }
+
+    // Everything reachable from the roots is kept.
+    vector<bool> keep(states.size(), false);
+    vector<size_t> rootIndexes;
+
+    if (graphIndexOf(activeState.id) != StateGraph::noState)
+    {
+        rootIndexes.push_back(graphIndexOf(activeState.id));
+    }
+    else
+    {
+        for (size_t i = 0; i < states.size(); i++)
+        {
+            if (canTransitionToFromAnywhere(states[i]))
+            {
+                rootIndexes.push_back(i);
+            }
+        }
+
+        for (auto &global : globalTransitions)
+        {
+            rootIndexes.push_back(graphIndexOf(global.toId));
+        }
+    }
+
+    for (auto &root : roots)
+    {
+        unordered_map<string, size_t>::iterator found = graphIndexByName.find(root);
+
+        if (found != graphIndexByName.end())
+        {
+            rootIndexes.push_back(found->second);
+        }
+    }
+
+    for (size_t root : rootIndexes)
+    {
+        const uint64_t *reachable = graph.reachableFrom(root);
+
+        keep[root] = true;
+
+        for (size_t i = 0; i < states.size(); i++)
+        {
+            keep[i] = keep[i] || ((reachable[i / 64] >> (i % 64)) & 1);
+        }
+    }
+
+    // Renumber the kept states densely in their current order, id 0 stays reserved for the dummy state.
+    vector<size_t> newIdById(nextStateId, StateGraph::noState);
+    size_t keptCount = 0;
+
+    newIdById[dummyState.id] = 0;
+
+    for (size_t i = 0; i < states.size(); i++)
+    {
+        if (keep[i])
+        {
+            newIdById[states[i].id] = ++keptCount;
+        }
+    }
+
+    for (size_t to = 0; to < declaredSources.size(); to++)
+    {
+        State *target = getStateById(to);
+        bool targetCanFire = target != nullptr && newIdById[to] != StateGraph::noState && target->transitionToState != nullptr && target->transitionToState != dummyTransitionToState;
+
+        vector<size_t> remaining;
+
+        for (size_t source : declaredSources[to])
+        {
+            if (targetCanFire && newIdById[source] != StateGraph::noState)
+            {
+                remaining.push_back(source);
+            }
+            else if (target != nullptr)
+            {
+                // Sources removed with removeState() no longer have a name, but still restrict the target until now.
+                string sourceName = getStateById(source) != nullptr ? getStateById(source)->stateName : "(removed state)";
+
+                report.removedTransitions.push_back(make_pair(sourceName, target->stateName));
+            }
+        }
+
+        // Without any source left the transition function can never be called, so it must not fall back to any state.
+        if (remaining.empty() && !declaredSources[to].empty() && target != nullptr)
+        {
+            target->transitionToState = dummyTransitionToState;
+        }
+
+        declaredSources[to].swap(remaining);
+        report.transitionsAfter += declaredSources[to].size();
+    }
+
+    for (size_t trigger = 0; trigger < edgeTriggers.size(); trigger++)
+    {
+        const EdgeTrigger &t = edgeTriggers[trigger];
+
+        // Triggers already dropped (ex: by removeState()) have no states left to look up.
+        if (t.blackboard == nullptr || t.fromId == StateGraph::noState || t.toId == StateGraph::noState)
+        {
+            continue;
+        }
+
+        if (newIdById[t.fromId] == StateGraph::noState || newIdById[t.toId] == StateGraph::noState)
+        {
+            report.removedTransitions.push_back(make_pair(stateNameById(t.fromId), stateNameById(t.toId)));
+
+            dropEdgeTrigger(trigger);
+
+            continue;
+        }
+
+        report.transitionsAfter++;
+    }
+
+    for (size_t from = 0; from < eventTransitions.size(); from++)
+    {
+        vector<EventTransition> remaining;
+
+        for (auto &t : eventTransitions[from])
+        {
+            if (newIdById[from] != StateGraph::noState && t.toId != StateGraph::noState && newIdById[t.toId] != StateGraph::noState)
+            {
+                remaining.push_back(t);
+            }
+            else if (getStateById(from) != nullptr)
+            {
+                report.removedTransitions.push_back(make_pair(getStateById(from)->stateName, t.toId != StateGraph::noState ? stateNameById(t.toId) : "(removed state)"));
+            }
+        }
+
+        eventTransitions[from].swap(remaining);
+        report.transitionsAfter += eventTransitions[from].size();
+    }
+
+    vector<State> kept;
+
+    for (size_t i = 0; i < states.size(); i++)
+    {
+        if (keep[i])
+        {
+            kept.push_back(states[i]);
+        }
+        else
+        {
+            report.removedStates.push_back(states[i].stateName);
+        }
+    }
+
+    states.swap(kept);
+
+    renumberStates(newIdById);
+    indexStates();
+
+    finalize();
+
+    report.statesAfter = states.size();
+
+    return report;
+}
+
+void StateManager::renumberStates(const vector<size_t> &newIdById)
+{
+    size_t newIdCount = states.size() + 1;
+
+    for (auto &s : states)
+    {
+        s.id = newIdById[s.id];
+    }
+
+    activeState.id = activeState.id < newIdById.size() && newIdById[activeState.id] != StateGraph::noState ? newIdById[activeState.id] : 0;
+
+    remapById(stateMetrics, newIdById, newIdCount);
+    remapById(dwellHistograms, newIdById, newIdCount);
+    remapById(perfCountersPerState, newIdById, newIdCount);
+    remapById(edgeHysteresis, newIdById, newIdCount);
+    remapById(declaredSources, newIdById, newIdCount);
+    remapById(stateLocals, newIdById, newIdCount);
+
+    for (auto &edges : edgeHysteresis)
+    {
+        vector<EdgeHysteresis> remaining;
+
+        for (auto &h : edges)
+        {
+            if (newIdById[h.fromId] != StateGraph::noState)
+            {
+                h.fromId = newIdById[h.fromId];
+                remaining.push_back(h);
+            }
+        }
+
+        edges.swap(remaining);
+    }
+
+    updateTransitionTiming();
+
+    for (auto &sources : declaredSources)
+    {
+        for (auto &source : sources)
+        {
+            source = newIdById[source];
+        }
+    }
+
+    for (auto &trigger : edgeTriggers)
+    {
+        if (trigger.blackboard != nullptr)
+        {
+            trigger.fromId = newIdById[trigger.fromId];
+            trigger.toId = newIdById[trigger.toId];
+        }
+    }
+
+    remapById(hierarchy, newIdById, newIdCount);
+
+    // Children of removed composites become top-level states, removed children are forgotten.
+    for (auto &h : hierarchy)
+    {
+        size_t *links[] = {&h.parent, &h.initialChild, &h.lastChild, &h.lastLeaf};
+
+        for (size_t *link : links)
+        {
+            *link = *link != StateGraph::noState ? newIdById[*link] : StateGraph::noState;
+        }
+    }
+
+    remapById(eventTransitions, newIdById, newIdCount);
+    remapById(deferMasks, newIdById, newIdCount);
+
+    for (auto &transitions : eventTransitions)
+    {
+        for (auto &t : transitions)
+        {
+            t.toId = newIdById[t.toId];
+        }
+    }
+
+    compositeCount = 0;
+
+    for (auto &h : hierarchy)
+    {
+        compositeCount += h.initialChild != StateGraph::noState ? 1 : 0;
+    }
+
+    // Global transitions always target a kept state: their targets are reachable from every state.
+    for (auto &global : globalTransitions)
+    {
+        global.toId = newIdById[global.toId];
+    }
+
+    remapById(transitionMetrics, newIdById, newIdCount);
+
+    for (auto &edges : transitionMetrics)
+    {
+        vector<TransitionMetric> remaining;
+
+        for (auto &edge : edges)
+        {
+            if (newIdById[edge.toId] != StateGraph::noState)
+            {
+                edge.toId = newIdById[edge.toId];
+                remaining.push_back(edge);
+            }
+        }
+
+        edges.swap(remaining);
+    }
+
+    map<pair<size_t, size_t>, EdgeFlips> remappedFlips;
+
+    for (auto &edge : edgeFlips)
+    {
+        if (newIdById[edge.first.first] != StateGraph::noState && newIdById[edge.first.second] != StateGraph::noState)
+        {
+            remappedFlips[make_pair(newIdById[edge.first.first], newIdById[edge.first.second])] = edge.second;
+        }
+    }
+
+    edgeFlips.swap(remappedFlips);
+
+    nextStateId = newIdCount;
+    graphFinalized = false;
+}
+
+string StateManager::PruneReport::toString() const
+{
+    ostringstream out;
+
+    out << "states: " << statesBefore << " -> " << statesAfter << ", transitions: " << transitionsBefore << " -> " << transitionsAfter << "\n";
+
+    for (auto &s : removedStates)
+    {
+        out << "removed state " << s << "\n";
+    }
+
+    for (auto &t : removedTransitions)
+    {
+        out << "removed transition " << t.first << " -> " << t.second << "\n";
+    }
+
+    return out.str();
+}
+
+StateDefinition *StateManager::compile()
+{
+    StateDefinition *definition = new StateDefinition();
+
+    indexStates();
+
+    // State ids are renumbered densely, in the order of the states.
+    auto indexOf = [this](size_t id) { return id < stateIndexById.size() ? stateIndexById[id] : StateDefinition::noState; };
+
+    definition->states.resize(states.size());
+    definition->sourceStart.assign(states.size() + 1, 0);
+
+    for (size_t i = 0; i < states.size(); i++)
+    {
+        const State &s = states[i];
+        const StateHierarchy &h = hierarchy[s.id];
+        StateDefinition::State &compiled = definition->states[i];
+
+        compiled.stateName = s.stateName;
+        compiled.stateFunction = s.stateFunction;
+        compiled.transitionToState = s.transitionToState;
+        compiled.parent = indexOf(h.parent);
+        compiled.initialChild = indexOf(h.initialChild);
+        compiled.composite = compiled.initialChild != StateDefinition::noState ? definition->compositeCount++ : StateDefinition::noState;
+        compiled.history = h.history;
+        compiled.restricted = s.id < declaredSources.size() && !declaredSources[s.id].empty();
+
+        definition->indexByName[s.stateName] = i;
+
+        size_t first = definition->sources.size();
+
+        if (compiled.restricted)
+        {
+            for (size_t source : declaredSources[s.id])
+            {
+                if (indexOf(source) != StateDefinition::noState)
+                {
+                    definition->sources.push_back(indexOf(source));
+                }
+            }
+        }
+
+        sort(definition->sources.begin() + first, definition->sources.end());
+
+        definition->sourceStart[i + 1] = definition->sources.size();
+    }
+
+    definition->initialState = indexOf(activeState.id);
+
+    for (size_t id = 0; id < eventTransitions.size(); id++)
+    {
+        for (auto &t : eventTransitions[id])
+        {
+            definition->events.push_back(t.event);
+        }
+    }
+
+    sort(definition->events.begin(), definition->events.end());
+    definition->events.erase(unique(definition->events.begin(), definition->events.end()), definition->events.end());
+
+    // Fold the event transitions of composite states into their children, so dispatching is a single lookup.
+    // Only the transitions that exist are visited, so compiling costs nothing per empty cell of the table.
+    size_t eventCount = definition->events.size();
+    definition->eventTable.reset(states.size(), eventCount);
+
+    // The state whose row last took an event (a child handling an event hides the transitions of its parents).
+    vector<size_t> handledBy(eventCount, StateDefinition::noState);
+
+    for (size_t i = 0; i < states.size(); i++)
+    {
+        for (size_t state = i; state != StateDefinition::noState; state = definition->states[state].parent)
+        {
+            size_t id = states[state].id;
+
+            for (size_t t = 0; id < eventTransitions.size() && t < eventTransitions[id].size(); t++)
+            {
+                size_t e = static_cast<size_t>(lower_bound(definition->events.begin(), definition->events.end(), eventTransitions[id][t].event) - definition->events.begin());
+                size_t target = indexOf(eventTransitions[id][t].toId);
+
+                if (handledBy[e] == i)
+                {
+                    continue;
+                }
+
+                handledBy[e] = i;
+
+                if (target != StateDefinition::noState)
+                {
+                    definition->eventTable.set(i, e, static_cast<uint32_t>(target));
+                }
+            }
+        }
+    }
+
+    definition->eventTable.compile();
+
+    for (auto &global : globalTransitions)
+    {
+        if (indexOf(global.toId) != StateDefinition::noState)
+        {
+            StateDefinition::GlobalTransition compiled;
+            compiled.toState = indexOf(global.toId);
+            compiled.transitionToState = global.transitionToState;
+
+            definition->globalTransitions.push_back(compiled);
+        }
+    }
+
+    return definition;
+}
+
+bool StateManager::addGlobalTransition(string toState, bool (*transitionToState)(string activeState), int priority)
+{
+    if (!withGlobalTransitions)
+    {
+        return false;
+    }
+
+    State *to = getStateByName(toState);
+
+    if (to == nullptr || transitionToState == nullptr)
+    {
+        return false;
+    }
+
+    GlobalTransition global;
+    global.toId = to->id;
+    global.transitionToState = transitionToState;
+    global.priority = priority;
+
+    // Keep the list sorted by descending priority, transitions with the same priority in the order they were added.
+    size_t position = globalTransitions.size();
+
+    while (position > 0 && globalTransitions[position - 1].priority < priority)
+    {
+        position--;
+    }
+
+    globalTransitions.insert(globalTransitions.begin() + position, global);
+
+    graphFinalized = false;
+
+    return true;
+}
+
+bool StateManager::takeGlobalTransition()
+{
+    for (auto &global : globalTransitions)
+    {
+        // A global transition to a composite state the active state is already in would only restart the composite.
+        if (isWithin(global.toId) || !global.transitionToState(activeState.stateName))
+        {
+            continue;
+        }
+
+        State *target = getStateById(global.toId);
+
+        if (target == nullptr)
+        {
+            continue;
+        }
+
+        enterState(*target);
+
+        return true;
+    }
+
+    return false;
+}
+
+StateManager::State &StateManager::resolveEntry(State &state)
+{
+    size_t id = state.id;
+
+    while (id < hierarchy.size() && hierarchy[id].initialChild != StateGraph::noState)
+    {
+        const StateHierarchy &h = hierarchy[id];
+
+        if (h.history == DeepHistory && h.lastLeaf != StateGraph::noState)
+        {
+            id = h.lastLeaf;
+            break;
+        }
+
+        id = h.history == ShallowHistory && h.lastChild != StateGraph::noState ? h.lastChild : h.initialChild;
+    }
+
+    State *leaf = getStateById(id);
+
+    return leaf != nullptr ? *leaf : state;
+}
+
+void StateManager::recordHistory(size_t leafId)
+{
+    if (leafId >= hierarchy.size())
+    {
+        return;
+    }
+
+    size_t child = leafId;
+
+    for (size_t parent = hierarchy[leafId].parent; parent != StateGraph::noState; parent = hierarchy[parent].parent)
+    {
+        hierarchy[parent].lastChild = child;
+        hierarchy[parent].lastLeaf = leafId;
+
+        child = parent;
+    }
+}
+
+void StateManager::detachFromHierarchy(size_t id)
+{
+    if (id >= hierarchy.size())
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < hierarchy.size(); i++)
+    {
+        StateHierarchy &h = hierarchy[i];
+
+        if (h.parent == id)
+        {
+            h.parent = StateGraph::noState;
+        }
+
+        if (h.lastChild == id || h.lastLeaf == id)
+        {
+            h.lastChild = StateGraph::noState;
+            h.lastLeaf = StateGraph::noState;
+        }
+
+        if (h.initialChild == id)
+        {
+            h.initialChild = StateGraph::noState;
+
+            // Fall back to another child, or stop being a composite state.
+            for (size_t j = 0; j < hierarchy.size(); j++)
+            {
+                if (j != id && hierarchy[j].parent == i)
+                {
+                    h.initialChild = j;
+                    break;
+                }
+            }
+
+            compositeCount -= h.initialChild == StateGraph::noState ? 1 : 0;
+        }
+    }
+
+    if (hierarchy[id].initialChild != StateGraph::noState)
+    {
+        compositeCount--;
+    }
+
+    hierarchy[id] = StateHierarchy();
+}
+
+void StateManager::detachFromParent(size_t id)
+{
+    size_t parent = hierarchy[id].parent;
+
+    hierarchy[id].parent = StateGraph::noState;
+
+    // The history of the old ancestors must not lead back into the child.
+    for (size_t ancestor = parent; ancestor != StateGraph::noState; ancestor = hierarchy[ancestor].parent)
+    {
+        StateHierarchy &h = hierarchy[ancestor];
+
+        for (size_t leaf = h.lastLeaf; leaf != StateGraph::noState; leaf = hierarchy[leaf].parent)
+        {
+            if (leaf == id)
+            {
+                h.lastChild = StateGraph::noState;
+                h.lastLeaf = StateGraph::noState;
+                break;
+            }
+        }
+    }
+
+    StateHierarchy &h = hierarchy[parent];
+
+    if (h.initialChild != id)
+    {
+        return;
+    }
+
+    // Fall back to another child, or stop being a composite state.
+    h.initialChild = StateGraph::noState;
+
+    for (size_t j = 0; j < hierarchy.size(); j++)
+    {
+        if (hierarchy[j].parent == parent)
+        {
+            h.initialChild = j;
+            break;
+        }
+    }
+
+    compositeCount -= h.initialChild == StateGraph::noState ? 1 : 0;
+}
+
+bool StateManager::setParentState(string childState, string parentState)
+{
+    if (!withHierarchy)
+    {
+        return false;
+    }
+
+    State *child = getStateByName(childState);
+    State *parent = getStateByName(parentState);
+
+    if (child == nullptr || parent == nullptr)
+    {
+        return false;
+    }
+
+    // A state cannot become a child of itself or of one of its own descendants.
+    for (size_t ancestor = parent->id; ancestor != StateGraph::noState; ancestor = hierarchy[ancestor].parent)
+    {
+        if (ancestor == child->id)
+        {
+            return false;
+        }
+    }
+
+    size_t oldParent = hierarchy[child->id].parent;
+
+    if (oldParent == parent->id)
+    {
+        return true;
+    }
+
+    if (oldParent != StateGraph::noState)
+    {
+        detachFromParent(child->id);
+    }
+
+    hierarchy[child->id].parent = parent->id;
+
+    // The first child becomes the initial state of the composite state.
+    if (hierarchy[parent->id].initialChild == StateGraph::noState)
+    {
+        hierarchy[parent->id].initialChild = child->id;
+        compositeCount++;
+    }
+
+    graphFinalized = false;
+
+    return true;
+}
+
+bool StateManager::setInitialState(string parentState, string childState)
+{
+    if (!withHierarchy)
+    {
+        return false;
+    }
+
+    State *child = getStateByName(childState);
+    State *parent = getStateByName(parentState);
+
+    if (child == nullptr || parent == nullptr || hierarchy[child->id].parent != parent->id)
+    {
+        return false;
+    }
+
+    hierarchy[parent->id].initialChild = child->id;
+
+    return true;
+}
+
+bool StateManager::setHistory(string compositeState, HistoryType history)
+{
+    if (!withHierarchy)
+    {
+        return false;
+    }
+
+    State *composite = getStateByName(compositeState);
+
+    if (composite == nullptr)
+    {
+        return false;
+    }
+
+    hierarchy[composite->id].history = history;
+
+    return true;
+}
+
+bool StateManager::isWithin(size_t id)
+{
+    for (size_t ancestor = activeState.id; ancestor < hierarchy.size(); ancestor = hierarchy[ancestor].parent)
+    {
+        if (ancestor == id)
+        {
+            return true;
+        }
+    }
+
+    return activeState.id == id;
+}
+
+bool StateManager::isInState(string stateName)
+{
+    for (size_t id = activeState.id; id < hierarchy.size(); id = hierarchy[id].parent)
+    {
+        State *state = getStateById(id);
+
+        if (state != nullptr && state->stateName == stateName)
+        {
+            return true;
+        }
+    }
+
+    return activeState.stateName == stateName;
+}
+
+bool StateManager::setEventTransition(string fromState, unsigned event, string toState)
+{
+    State *from = getStateByName(fromState);
+    State *to = getStateByName(toState);
+
+    if (from == nullptr || to == nullptr)
+    {
+        return false;
+    }
+
+    if (eventTransitions.size() <= from->id)
+    {
+        eventTransitions.resize(from->id + 1);
+    }
+
+    vector<EventTransition> &transitions = eventTransitions[from->id];
+
+    for (auto &t : transitions)
+    {
+        if (t.event == event)
+        {
+            t.toId = to->id;
+            graphFinalized = false;
+
+            return true;
+        }
+    }
+
+    EventTransition t;
+    t.event = event;
+    t.toId = to->id;
+
+    transitions.push_back(t);
+
+    graphFinalized = false;
+
+    return true;
+}
+
+bool StateManager::deferEvent(string stateName, unsigned event)
+{
+    if (!withDeferral)
+    {
+        return false;
+    }
+
+    State *state = getStateByName(stateName);
+
+    if (state == nullptr)
+    {
+        return false;
+    }
+
+    if (deferMasks.size() <= state->id)
+    {
+        deferMasks.resize(state->id + 1);
+    }
+
+    vector<uint64_t> &mask = deferMasks[state->id];
+
+    if (mask.size() <= event / 64)
+    {
+        mask.resize(event / 64 + 1, 0);
+    }
+
+    mask[event / 64] |= uint64_t(1) << (event % 64);
+
+    // Keep the mask of the deferred events as wide as the widest defer mask, so deferring never allocates.
+    if (deferredMask.size() < mask.size())
+    {
+        deferredMask.resize(mask.size(), 0);
+    }
+
+    return true;
+}
+
+bool StateManager::defers(size_t id, unsigned event)
+{
+    for (; id < nextStateId; id = id < hierarchy.size() ? hierarchy[id].parent : StateGraph::noState)
+    {
+        if (id < deferMasks.size() && event / 64 < deferMasks[id].size() && (deferMasks[id][event / 64] >> (event % 64)) & 1)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+StateManager::State *StateManager::eventTarget(unsigned event)
+{
+    // The active state handles the event first, then its composite states from the inside out.
+    for (size_t id = activeState.id; id < nextStateId; id = id < hierarchy.size() ? hierarchy[id].parent : StateGraph::noState)
+    {
+        if (id >= eventTransitions.size())
+        {
+            continue;
+        }
+
+        for (auto &t : eventTransitions[id])
+        {
+            if (t.event == event)
+            {
+                return getStateById(t.toId);
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+bool StateManager::dispatchEvent(unsigned event)
+{
+    State *target = eventTarget(event);
+
+    if (target != nullptr)
+    {
+        enterState(*target);
+
+        return true;
+    }
+
+    if (!defers(activeState.id, event))
+    {
+        return false;
+    }
+
+    if (deferredCount == deferredEvents.size())
+    {
+        droppedDeferredEvents++;
+
+        return false;
+    }
+
+    deferredEvents[(deferredHead + deferredCount) % deferredEvents.size()] = event;
+    deferredCount++;
+
+    deferredMask[event / 64] |= uint64_t(1) << (event % 64);
+
+    return false;
+}
+
+void StateManager::reofferDeferredEvents()
+{
+    reofferingDeferred = true;
+
+    bool changed = true;
+
+    while (changed && deferredCount > 0)
+    {
+        // If the new state still defers every deferred event, there is nothing to offer. Handling comes before
+        // deferring (a substate handling an event overrides a deferral inherited from its composite states), so
+        // the events the new state handles are not deferred by it.
+        bool stillDeferred = true;
+
+        for (size_t w = 0; w < deferredMask.size() && stillDeferred; w++)
+        {
+            uint64_t deferredByState = 0;
+            uint64_t handledByState = 0;
+
+            for (size_t id = activeState.id; id < nextStateId; id = id < hierarchy.size() ? hierarchy[id].parent : StateGraph::noState)
+            {
+                deferredByState |= id < deferMasks.size() && w < deferMasks[id].size() ? deferMasks[id][w] : 0;
+
+                for (size_t t = 0; id < eventTransitions.size() && t < eventTransitions[id].size(); t++)
+                {
+                    const EventTransition &handled = eventTransitions[id][t];
+                    handledByState |= handled.event / 64 == w && handled.toId != StateGraph::noState ? uint64_t(1) << (handled.event % 64) : 0;
+                }
+            }
+
+            stillDeferred = (deferredMask[w] & ~(deferredByState & ~handledByState)) == 0;
+        }
+
+        if (stillDeferred)
+        {
+            break;
+        }
+
+        changed = false;
+
+        size_t offered = deferredCount;
+
+        for (auto &word : deferredMask)
+        {
+            word = 0;
+        }
+
+        // Every event is taken from the front and either handled, deferred again at the back or dropped.
+        for (size_t i = 0; i < offered; i++)
+        {
+            unsigned event = deferredEvents[deferredHead];
+
+            deferredHead = (deferredHead + 1) % deferredEvents.size();
+            deferredCount--;
+
+            size_t before = transitionCount;
+
+            dispatchEvent(event);
+
+            changed = changed || transitionCount != before;
+        }
+    }
+
+    reofferingDeferred = false;
+}
+
+void StateManager::setDeferredCapacity(size_t capacity)
+{
+    deferredEvents = vector<unsigned>(capacity == 0 ? 1 : capacity);
+    deferredHead = 0;
+    deferredCount = 0;
+
+    for (auto &word : deferredMask)
+    {
+        word = 0;
+    }
+}
+
+size_t StateManager::getDeferredEventCount()
+{
+    return deferredCount;
+}
+
+uint64_t StateManager::getDroppedDeferredEvents()
+{
+    return droppedDeferredEvents;
+}
+
+void StateManager::setEventQueue(StateEventQueue *eventQueue)
+{
+    this->eventQueue = eventQueue;
+
+    queueDroppedSeen = eventQueue == nullptr ? 0 : eventQueue->getDroppedEvents();
+    queueCoalescedSeen = eventQueue == nullptr ? 0 : eventQueue->getCoalescedEvents();
+}
+
+size_t StateManager::processEvents(size_t maxEvents)
+{
+    if (eventQueue == nullptr)
+    {
+        return 0;
+    }
+
+    if (metrics != nullptr)
+    {
+        metrics->set(queueDepthMetrics[StateEventQueue::Normal], static_cast<int64_t>(eventQueue->size(StateEventQueue::Normal)));
+        metrics->set(queueDepthMetrics[StateEventQueue::High], static_cast<int64_t>(eventQueue->size(StateEventQueue::High)));
+
+        uint64_t dropped = eventQueue->getDroppedEvents();
+        uint64_t coalesced = eventQueue->getCoalescedEvents();
+
+        metrics->increment(queueDroppedMetric, dropped - queueDroppedSeen);
+        metrics->increment(queueCoalescedMetric, coalesced - queueCoalescedSeen);
+
+        queueDroppedSeen = dropped;
+        queueCoalescedSeen = coalesced;
+    }
+
+    size_t processed = 0;
+    unsigned event;
+
+    while (processed < maxEvents && eventQueue->pop(event))
+    {
+        dispatchEvent(event);
+        processed++;
+    }
+
+    return processed;
+}
+
+bool StateManager::setStateLocalLayout(string stateName, const StateLocal &layout)
+{
+    if (!withStateLocal)
+    {
+        return false;
+    }
+
+    State *state = getStateByName(stateName);
+
+    if (state == nullptr)
+    {
+        return false;
+    }
+
+    if (stateLocals.size() <= state->id)
+    {
+        stateLocals.resize(state->id + 1);
+    }
+
+    stateLocals[state->id] = layout;
+
+    // Room for the storage at any alignment, followed by the scratch memory.
+    size_t needed = layout.size + layout.alignment - 1 + layout.scratchBytes;
+
+    if (needed > stateArena.capacity())
+    {
+        reserveStateArena(needed);
+    }
+    else if (activeState.id == state->id)
+    {
+        releaseStateLocal();
+        acquireStateLocal(activeState.id);
+    }
+
+    return true;
+}
+
+void StateManager::reserveStateScratch(size_t scratchBytes)
+{
+    if (!withStateLocal)
+    {
+        return;
+    }
+
+    if (scratchBytes > stateArena.capacity())
+    {
+        reserveStateArena(scratchBytes);
+    }
+}
+
+void StateManager::reserveStateArena(size_t capacity)
+{
+    releaseStateLocal();
+    stateArena.reserve(capacity);
+    acquireStateLocal(activeState.id);
+}
+
+bool StateManager::clearStateLocal(string stateName)
+{
+    State *state = getStateByName(stateName);
+
+    if (state == nullptr)
+    {
+        return false;
+    }
+
+    if (state->id < stateLocals.size())
+    {
+        stateLocals[state->id] = StateLocal();
+    }
+
+    if (activeState.id == state->id)
+    {
+        releaseStateLocal();
+    }
+
+    return true;
+}
+
+void StateManager::acquireStateLocal(size_t id)
+{
+    if (id >= stateLocals.size() || stateLocals[id].construct == nullptr)
+    {
+        return;
+    }
+
+    const StateLocal &layout = stateLocals[id];
+
+    // The arena is sized for the largest state, so this never fails.
+    activeLocal = stateArena.allocate(layout.size, layout.alignment);
+    activeLocalType = layout.type;
+    activeLocalDestroy = layout.destroy;
+
+    layout.construct(activeLocal);
+}
+
+void StateManager::releaseStateLocal()
+{
+    if (activeLocalDestroy != nullptr)
+    {
+        activeLocalDestroy(activeLocal);
+    }
+
+    activeLocal = nullptr;
+    activeLocalType = nullptr;
+    activeLocalDestroy = nullptr;
+
+    stateArena.reset();
+}
@@ -11,18 +11,55 @@
 #ifndef STATEMANAGER_HPP
 #define STATEMANAGER_HPP
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <new>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "StateArena.hpp"
+#include "StateBlackboard.hpp"
+#include "StateDefinition.hpp"
+#include "StateEventQueue.hpp"
+#include "StateGraph.hpp"
+#include "StateHistogram.hpp"
+#include "StateManagerFeatures.hpp"
+#include "StateMetrics.hpp"
+#include "StatePerfCounters.hpp"
+
 using namespace std;
 
 class StateManager
 {
 private:
+    // The features compiled in (see StateManagerFeatures.hpp). Checks of the others are constant false conditions.
+    static const bool withMetrics = (STATEMANAGER_FEATURES & STATEMANAGER_FEATURE_METRICS) != 0;
+    static const bool withDwellHistograms = (STATEMANAGER_FEATURES & STATEMANAGER_FEATURE_DWELL_HISTOGRAMS) != 0;
+    static const bool withPerfCounters = (STATEMANAGER_FEATURES & STATEMANAGER_FEATURE_PERF_COUNTERS) != 0;
+    static const bool withHysteresis = (STATEMANAGER_FEATURES & STATEMANAGER_FEATURE_HYSTERESIS) != 0;
+    static const bool withOscillationDetection = (STATEMANAGER_FEATURES & STATEMANAGER_FEATURE_OSCILLATION_DETECTION) != 0;
+    static const bool withEdgeTriggers = (STATEMANAGER_FEATURES & STATEMANAGER_FEATURE_EDGE_TRIGGERS) != 0;
+    static const bool withDeclaredTransitions = (STATEMANAGER_FEATURES & STATEMANAGER_FEATURE_DECLARED_TRANSITIONS) != 0;
+    static const bool withGlobalTransitions = (STATEMANAGER_FEATURES & STATEMANAGER_FEATURE_GLOBAL_TRANSITIONS) != 0;
+    static const bool withHierarchy = (STATEMANAGER_FEATURES & STATEMANAGER_FEATURE_HIERARCHY) != 0;
+    static const bool withDeferral = (STATEMANAGER_FEATURES & STATEMANAGER_FEATURE_DEFERRAL) != 0;
+    static const bool withStateLocal = (STATEMANAGER_FEATURES & STATEMANAGER_FEATURE_STATE_LOCAL) != 0;
+
+    // Whether any compiled in feature needs to know how long states stay active.
+    static const bool withTiming = withMetrics || withDwellHistograms || withHysteresis || withOscillationDetection;
+
     struct State
     {
         string stateName;
 
+        size_t id;
+
         bool (*stateFunction)();
         bool (*transitionToState)(string activeState);
 
@@ -41,10 +78,283 @@ private:
 
     State dummyState;
 
+    // The state activeState refers to. It is separate from dummyState, so entering a state never overwrites the dummy state.
+    State currentState;
+
     static bool dummyStateFunction();
 
     static bool dummyTransitionToState(string activeState);
 
+    void enterState(State &state);
+
+    size_t nextStateId;
+
+    chrono::steady_clock::time_point stateEnteredAt;
+    uint64_t transitionCount;
+
+    // Whether a feature needs to know how long states stay active (metrics, dwell histograms, oscillation
+    // detection or a minimum dwell). Otherwise transitions do not read the clock and stateEnteredAt is stale.
+    bool timedTransitions;
+
+    void updateTransitionTiming();
+
+    struct StateMetricIds
+    {
+        StateMetrics::MetricId guardCalls;
+        StateMetrics::MetricId guardTrue;
+        StateMetrics::MetricId timeInState;
+        bool registered;
+
+        StateMetricIds() : guardCalls(StateMetrics::invalidMetric), guardTrue(StateMetrics::invalidMetric), timeInState(StateMetrics::invalidMetric), registered(false) {}
+    };
+
+    const StateMetricIds &stateMetricIds(const State &state);
+
+    StateMetrics *metrics;
+    string metricsMachineName;
+    StateMetrics::MetricId ticksMetric;
+    StateMetrics::MetricId queueDepthMetrics[2];
+    StateMetrics::MetricId queueDroppedMetric;
+    StateMetrics::MetricId queueCoalescedMetric;
+    StateMetrics::MetricId unregisteredTransitionsMetric;
+    vector<StateMetricIds> stateMetrics;
+    struct TransitionMetric
+    {
+        size_t toId;
+
+        // invalidMetric if the registry was full, so the edge is counted as unregistered without trying again.
+        StateMetrics::MetricId id;
+    };
+
+    // The transition counters registered so far, indexed by the id of the state the transitions start from.
+    vector<vector<TransitionMetric>> transitionMetrics;
+
+    // Find the counter of an edge, registering it the first time the edge is seen.
+    StateMetrics::MetricId transitionMetricId(const State &from, const State &to);
+
+    // Registers a counter for every declared edge of the transition graph, so ticks only register the others.
+    bool registerTransitionMetrics(const vector<pair<size_t, size_t>> &edges);
+    bool transitionMetricsRegistered;
+
+    bool dwellHistogramsEnabled;
+    vector<StateHistogram> dwellHistograms;
+
+    unique_ptr<StatePerfCounters> perfCounters;
+    StatePerfCounters::Sample perfCountersAtEntry;
+    bool perfCountersAtEntryValid;
+    vector<StatePerfCounters::Sample> perfCountersPerState;
+
+    struct EdgeHysteresis
+    {
+        size_t fromId;
+        chrono::nanoseconds minDwell;
+        unsigned consecutiveTrue;
+        unsigned trueCount;
+        uint64_t countedAtTransition;
+    };
+
+    // Indexed by the id of the state being transitioned to.
+    vector<vector<EdgeHysteresis>> edgeHysteresis;
+
+    bool debounce(const State &state, bool wantsToBecomeActive);
+
+    struct EdgeFlips
+    {
+        chrono::steady_clock::time_point windowStart;
+        unsigned transitions;
+        bool reported;
+
+        EdgeFlips() : transitions(0), reported(false) {}
+    };
+
+    chrono::nanoseconds oscillationWindow;
+    unsigned oscillationMaxTransitions;
+    void (*oscillationHandler)(const string &fromState, const string &toState, unsigned transitions);
+    map<pair<size_t, size_t>, EdgeFlips> edgeFlips;
+
+    void detectOscillation(const State &from, const State &to, chrono::steady_clock::time_point now);
+
+    string stateNameById(size_t id);
+
+    State *getStateById(size_t id);
+
+    // Position of every state in states, indexed by state id.
+    vector<size_t> stateIndexById;
+
+    void indexStates();
+
+    friend class StateBlackboard;
+
+    struct EdgeTrigger
+    {
+        size_t fromId;
+        size_t toId;
+        StateBlackboard *blackboard;
+    };
+
+    vector<EdgeTrigger> edgeTriggers;
+    vector<size_t> pendingTriggers;
+    vector<bool> triggerPending;
+
+    void notifyEdgeTrigger(size_t trigger);
+
+    void detachBlackboard(StateBlackboard *blackboard);
+
+    // Unsubscribes the trigger from its blackboard. It keeps its slot (the blackboard refers to it by index) but never matches again.
+    void dropEdgeTrigger(size_t trigger);
+
+    bool takeEdgeTrigger();
+
+    // Indexed by the id of the state being transitioned to, empty if it can be transitioned to from any state.
+    vector<vector<size_t>> declaredSources;
+
+    bool isDeclaredSource(const State &state, size_t fromId);
+
+    StateGraph graph;
+    bool graphFinalized;
+    vector<size_t> graphIndexById;
+    unordered_map<string, size_t> graphIndexByName;
+
+    size_t graphIndexOf(size_t id);
+
+    void renumberStates(const vector<size_t> &newIdById);
+
+    struct GlobalTransition
+    {
+        size_t toId;
+        bool (*transitionToState)(string activeState);
+        int priority;
+    };
+
+    // Sorted by descending priority.
+    vector<GlobalTransition> globalTransitions;
+
+    bool takeGlobalTransition();
+
+    // True if the active state is the state or one of its descendants.
+    bool isWithin(size_t id);
+
+public:
+    enum HistoryType
+    {
+        NoHistory,
+        ShallowHistory,
+        DeepHistory
+    };
+
+private:
+    struct StateHierarchy
+    {
+        size_t parent;
+        size_t initialChild;
+        HistoryType history;
+
+        // The child and the leaf state that were active when the composite state was last left.
+        size_t lastChild;
+        size_t lastLeaf;
+
+        StateHierarchy() : parent(StateGraph::noState), initialChild(StateGraph::noState), history(NoHistory), lastChild(StateGraph::noState), lastLeaf(StateGraph::noState) {}
+    };
+
+    // Indexed by state id.
+    vector<StateHierarchy> hierarchy;
+    size_t compositeCount;
+
+    State &resolveEntry(State &state);
+
+    void recordHistory(size_t leafId);
+
+    void detachFromHierarchy(size_t id);
+
+    void detachFromParent(size_t id);
+
+    struct EventTransition
+    {
+        unsigned event;
+        size_t toId;
+    };
+
+    // Indexed by the id of the state the transitions start from.
+    vector<vector<EventTransition>> eventTransitions;
+
+    // One bit per event, indexed by state id.
+    vector<vector<uint64_t>> deferMasks;
+
+    // The deferred events, in the order they arrived.
+    vector<unsigned> deferredEvents;
+    size_t deferredHead;
+    size_t deferredCount;
+    vector<uint64_t> deferredMask;
+    uint64_t droppedDeferredEvents;
+    bool reofferingDeferred;
+
+    State *eventTarget(unsigned event);
+
+    bool defers(size_t id, unsigned event);
+
+    void reofferDeferredEvents();
+
+    StateEventQueue *eventQueue;
+
+    // Queue counters already added to the metrics, so only the increase is added next time.
+    uint64_t queueDroppedSeen;
+    uint64_t queueCoalescedSeen;
+
+    bool canTransitionToFromAnywhere(const State &state);
+
+    struct StateLocal
+    {
+        size_t size;
+        size_t alignment;
+        size_t scratchBytes;
+
+        // Identifies the type of the storage, see getStateLocal().
+        const void *type;
+
+        void (*construct)(void *storage);
+
+        // Null for trivially destructible types, so nothing is called when they are released.
+        void (*destroy)(void *storage);
+
+        StateLocal() : size(0), alignment(1), scratchBytes(0), type(nullptr), construct(nullptr), destroy(nullptr) {}
+    };
+
+    // Indexed by state id.
+    vector<StateLocal> stateLocals;
+
+    StateArena stateArena;
+    void *activeLocal;
+    const void *activeLocalType;
+    void (*activeLocalDestroy)(void *storage);
+
+    // One tag per type, whose address identifies the type. Unlike the addresses of functions, the addresses of
+    // distinct writable variables cannot be merged by identical code folding.
+    template <typename T>
+    struct LocalType
+    {
+        static char tag;
+    };
+
+    template <typename T>
+    static void constructLocal(void *storage)
+    {
+        new (storage) T();
+    }
+
+    template <typename T>
+    static void destroyLocal(void *storage)
+    {
+        static_cast<T *>(storage)->~T();
+    }
+
+    bool setStateLocalLayout(string stateName, const StateLocal &layout);
+
+    void reserveStateArena(size_t capacity);
+
+    void acquireStateLocal(size_t id);
+
+    void releaseStateLocal();
+
 public:
     vector<State> states;
 
@@ -52,6 +362,8 @@ public:
 
     StateManager();
 
+    ~StateManager();
+
     /**
      * @brief Run the state manager running the active state without transitioning to the proper next state.
      * @return True if the state manager executed the active state succesfully.
@@ -93,6 +405,9 @@ public:
      * @brief Add a state to the state manager.
      * @param stateName The name of the new state.
      * @return True if the state was added successfully, false if the state already exists.
+     *
+     * @note Until its functions are set, the state function of the new state returns false and its transition
+     * function never wants to become active.
      */
     bool addState(string stateName);
 
@@ -126,6 +441,392 @@ public:
      * @return The name of the active state.
      */
     string getActiveStateName();
+
+    /**
+     * @brief Report ticks, transitions, guard calls and time in state to a metrics registry.
+     * @param metrics The registry to report to, or nullptr to stop reporting.
+     * @param machineName The value of the machine label attached to every metric of this state manager.
+     * @return True if the metrics were registered successfully, false if the registry is full or metrics are compiled out.
+     *
+     * @note Every counter is registered up front except for the transition counters of edges that were not
+     * declared (transitions to states without declared transitions, global transitions and transition(stateName)):
+     * there is one such edge for every pair of states, so their counters are registered the first time they are
+     * taken, which takes the lock of the registry once per edge. Transitions whose counter does not fit in the
+     * registry are counted in statemanager_transitions_unregistered_total.
+     * @note The registry must outlive the state manager (or be detached first).
+     */
+    bool setMetrics(StateMetrics *metrics, string machineName = "statemanager");
+
+    /**
+     * @brief Record how long every state stays active in a per-state histogram.
+     * @param enabled True to start recording, false to stop recording and free the histograms.
+     *
+     * @note A dwell time is recorded (in nanoseconds) every time a state is left.
+     */
+    void setDwellHistograms(bool enabled);
+
+    /**
+     * @brief Get the dwell time histogram of a state.
+     * @param stateName The name of the state.
+     * @return The histogram of the state, or nullptr if the state was not found or dwell histograms are disabled.
+     *
+     * @note Histograms of several state managers can be combined with StateHistogram::merge().
+     */
+    const StateHistogram *getDwellHistogram(string stateName);
+
+    /**
+     * @brief Attribute hardware performance counters (cycles, instructions, cache and branch misses) to the active state.
+     * @param enabled True to start counting, false to stop counting and close the counters.
+     * @return True if the counters are available (always true when disabling), false if perf events are not supported
+     * or compiled out.
+     *
+     * @note The counters are read every time the active state changes, so everything between two transitions
+     * (the state function and the transition functions) is attributed to the state that was active.
+     * @warning Only the calling thread is measured, so enable the counters from the thread that runs the state manager.
+     */
+    bool setPerfCounters(bool enabled);
+
+    /**
+     * @brief Get the performance counters attributed to a state so far.
+     * @param stateName The name of the state.
+     * @param sample The sample to fill in with the totals of the state.
+     * @return True if the state was found and the counters are available, false otherwise.
+     */
+    bool getPerfCounters(string stateName, StatePerfCounters::Sample &sample);
+
+    /**
+     * @brief Debounce the transition between two states.
+     * @param fromState The name of the state being transitioned from.
+     * @param toState The name of the state being transitioned to.
+     * @param minDwell The minimum time fromState has to be active before the transition can be taken.
+     * @param consecutiveTrue The number of consecutive times the transition function of toState has to return true.
+     * @return True if the hysteresis was set successfully, false if either state was not found or hysteresis is compiled out.
+     *
+     * @note While the transition is held back, the other states still get a chance to become active.
+     * @note Set minDwell to zero and consecutiveTrue to 1 (or less) to remove the hysteresis again.
+     */
+    bool setTransitionHysteresis(string fromState, string toState, chrono::nanoseconds minDwell, unsigned consecutiveTrue = 1);
+
+    struct Oscillation
+    {
+        string fromState;
+        string toState;
+        unsigned transitions;
+        double transitionsPerSecond;
+    };
+
+    /**
+     * @brief Detect transitions that are taken too often (ex: two states ping-ponging every tick).
+     * @param window The length of the time window transitions are counted in.
+     * @param maxTransitions The number of transitions within the window after which a transition is reported.
+     * @param onOscillation The function to call (once per window) when a transition is reported, or nullptr.
+     *
+     * @note Set window to zero to stop detecting oscillations.
+     */
+    void setOscillationDetection(chrono::nanoseconds window, unsigned maxTransitions, void (*onOscillation)(const string &fromState, const string &toState, unsigned transitions) = nullptr);
+
+    /**
+     * @brief Get the transitions that were reported as oscillating in the current (or the last) window.
+     * @return The oscillating transitions and how often they were taken.
+     */
+    vector<Oscillation> getOscillatingEdges();
+
+    /**
+     * @brief Add a transition that is taken once when a blackboard input changes from false to true.
+     * @param fromState The name of the state the transition starts from.
+     * @param toState The name of the state to transition to.
+     * @param blackboard The blackboard holding the input.
+     * @param inputName The name of the input (it is added to the blackboard if it does not exist yet).
+     * @return True if the transition was added successfully, false if either state was not found or edge triggers
+     * are compiled out.
+     *
+     * @note The rising edge is taken by the next transition, before any transition function is called.
+     * It is dropped if fromState is not active at that point.
+     * @note The blackboard notifies the state manager directly, so the input is never polled.
+     */
+    bool addEdgeTrigger(string fromState, string toState, StateBlackboard *blackboard, string inputName);
+
+    /**
+     * @brief Declare that a state can be transitioned to from another state.
+     * @param fromState The name of the state the transition starts from.
+     * @param toState The name of the state to transition to.
+     * @return True if the transition was declared successfully, false if either state was not found or declared
+     * transitions are compiled out.
+     *
+     * @note Once a state has declared transitions, its transition function is only called while one of their
+     * source states is active. States without declared transitions can be transitioned to from any state.
+     */
+    bool addTransition(string fromState, string toState);
+
+    /**
+     * @brief Analyze the transition graph, so reachability and navigation queries are answered in O(1).
+     *
+     * @note The graph is made of the declared transitions, the edge-triggered transitions and, for states
+     * without declared transitions, a transition from every other state (if the state has a transition function).
+     * @note Changing the states or transitions afterwards makes the next query finalize again.
+     */
+    void finalize();
+
+    /**
+     * @brief Check if a state can be reached from another state through the transition graph.
+     * @param fromState The name of the state to start from.
+     * @param toState The name of the state to reach.
+     * @return True if toState can be reached, false if not or if either state was not found.
+     */
+    bool isReachable(string fromState, string toState);
+
+    /**
+     * @brief Get the next state on a shortest path from the active state to a target state.
+     * @param targetState The name of the state to navigate to.
+     * @return The name of the state to transition to next, or an empty string if the target is the active state,
+     * cannot be reached or was not found.
+     */
+    string nextHopToward(string targetState);
+
+    /**
+     * @brief Get a shortest path from the active state to a target state.
+     * @param targetState The name of the state to navigate to.
+     * @return The names of the states to transition through, ending with the target (empty if it cannot be reached).
+     */
+    vector<string> pathToward(string targetState);
+
+    struct PruneReport
+    {
+        size_t statesBefore;
+        size_t statesAfter;
+        size_t transitionsBefore;
+        size_t transitionsAfter;
+
+        vector<string> removedStates;
+        vector<pair<string, string>> removedTransitions;
+
+        /**
+         * @brief Format the report for logging.
+         */
+        string toString() const;
+    };
+
+    /**
+     * @brief Finalize the state manager, removing the states and transitions that can never be used.
+     * @param roots Extra states that have to be kept reachable (ex: states only entered with transition(stateName)).
+     * @return A report of the removed states and transitions.
+     *
+     * @note States are kept if they can be reached from the active state (or, before any state was entered, from
+     * the states that can be transitioned to from any state) or from one of the roots. Declared and edge-triggered
+     * transitions are removed if they start from a removed state, and declared transitions are removed if the
+     * transition function of their target state can never return true.
+     * @note The remaining states are renumbered densely, so every per-state table shrinks with them.
+     * @warning States only entered with transition(stateName) have to be passed as roots, or they are removed.
+     */
+    PruneReport prune(vector<string> roots = vector<string>());
+
+    /**
+     * @brief Compile the states and transitions into an immutable definition, for StateMachine instances.
+     * @return A new definition, owned by the caller (ex: pass it to StateDefinitionDomain::publish()).
+     *
+     * @note The definition holds the states with their functions, the declared and global transitions, the
+     * composite states and the event transitions. Instrumentation, hysteresis, edge triggers, deferred
+     * events and state-local storage stay with the state manager.
+     */
+    StateDefinition *compile();
+
+    /**
+     * @brief Add a transition that can be taken from any state (ex: an emergency stop).
+     * @param toState The name of the state to transition to.
+     * @param transitionToState The function deciding if the transition should be taken.
+     * @param priority Global transitions with a higher priority are checked first.
+     * @return True if the transition was added successfully, false if the state was not found or global transitions
+     * are compiled out.
+     *
+     * @note Global transitions are checked once per transition, before any other transition,
+     * so they cost the same no matter how many states there are.
+     * @note A global transition is not taken while its target state is already active.
+     */
+    bool addGlobalTransition(string toState, bool (*transitionToState)(string activeState), int priority = 0);
+
+    /**
+     * @brief Make a state a child of a composite state.
+     * @param childState The name of the child state.
+     * @param parentState The name of the composite state.
+     * @return True if the parent was set successfully, false if either state was not found, it would create a cycle
+     * or composite states are compiled out.
+     *
+     * @note Transitioning to a composite state enters one of its children: the initial state (the first child
+     * by default), or the child restored by its history.
+     * @note A child that already has a parent is moved. If it was the initial state of its old parent, another
+     * child takes its place, and a parent left without children is no longer a composite state.
+     */
+    bool setParentState(string childState, string parentState);
+
+    /**
+     * @brief Set the child entered when a composite state is entered without history.
+     * @param parentState The name of the composite state.
+     * @param childState The name of the child state.
+     * @return True if the initial state was set successfully, false if either state was not found, it is not a child
+     * or composite states are compiled out.
+     */
+    bool setInitialState(string parentState, string childState);
+
+    /**
+     * @brief Set how a composite state is re-entered after it was left.
+     * @param compositeState The name of the composite state.
+     * @param history ShallowHistory restores the child that was last active (and enters it normally),
+     * DeepHistory restores the leaf state that was last active, NoHistory always enters the initial state.
+     * @return True if the history was set successfully, false if the state was not found or composite states are compiled out.
+     *
+     * @note The last active child and leaf of every composite state are kept in a dense array, so restoring them is O(1).
+     */
+    bool setHistory(string compositeState, HistoryType history);
+
+    /**
+     * @brief Check if a state is active, either as the active state or as one of its composite states.
+     * @param stateName The name of the state.
+     * @return True if the state is active.
+     */
+    bool isInState(string stateName);
+
+    /**
+     * @brief Add a transition that is taken when an event is dispatched while a state is active.
+     * @param fromState The name of the state the transition starts from (composite states handle the events of their children).
+     * @param event The id of the event.
+     * @param toState The name of the state to transition to.
+     * @return True if the transition was added successfully, false if either state was not found.
+     */
+    bool setEventTransition(string fromState, unsigned event, string toState);
+
+    /**
+     * @brief Keep an event the active state cannot handle yet instead of dropping it.
+     * @param stateName The name of the state deferring the event (composite states defer for their children).
+     * @param event The id of the event.
+     * @return True if the event is now deferred, false if the state was not found or deferral is compiled out.
+     *
+     * @note Deferred events are offered again, in the order they arrived, every time the active state changes.
+     */
+    bool deferEvent(string stateName, unsigned event);
+
+    /**
+     * @brief Dispatch an event to the active state.
+     * @param event The id of the event.
+     * @return True if the event made the state manager transition, false if it was deferred or dropped.
+     *
+     * @note Events the active state neither handles nor defers are dropped.
+     */
+    bool dispatchEvent(unsigned event);
+
+    /**
+     * @brief Set how many deferred events can be held at once.
+     * @param capacity The capacity of the deferred event ring (16 by default).
+     *
+     * @note Changing the capacity drops the events that are currently deferred. When the ring is full,
+     * newly deferred events are dropped (see getDroppedDeferredEvents()).
+     */
+    void setDeferredCapacity(size_t capacity);
+
+    /**
+     * @brief Get the number of events currently deferred.
+     */
+    size_t getDeferredEventCount();
+
+    /**
+     * @brief Get the number of events dropped because the deferred event ring was full.
+     */
+    uint64_t getDroppedDeferredEvents();
+
+    /**
+     * @brief Set the queue other threads post events to.
+     * @param eventQueue The queue to take events from in processEvents(), or nullptr.
+     *
+     * @note The queue must outlive the state manager (or be detached first).
+     */
+    void setEventQueue(StateEventQueue *eventQueue);
+
+    /**
+     * @brief Dispatch the events waiting in the event queue, high priority events first.
+     * @param maxEvents The maximum number of events to dispatch, to bound the time spent in one call.
+     * @return The number of events dispatched.
+     *
+     * @note Call this from the thread running the state manager, ex: once per tick before run().
+     */
+    size_t processEvents(size_t maxEvents = static_cast<size_t>(-1));
+
+    /**
+     * @brief Give a state local storage of type T, constructed every time the state is entered and released when it is left.
+     * @param stateName The name of the state.
+     * @param scratchBytes Extra bytes the state may take with allocateInState() while it is active (including alignment padding).
+     * @return True if the storage was set successfully, false if the state was not found or state-local storage
+     * is compiled out.
+     *
+     * @note The storage of every state comes from one arena, sized up front for the largest state, so entering a state
+     * never allocates. Types that are trivially destructible are released without calling anything.
+     * @note If the state is active, its storage is constructed right away.
+     * @warning Growing the arena (the first storage, or a larger one than before) releases the storage of the active state
+     * and constructs it again, so set the storage of every state before running the state manager.
+     */
+    template <typename T>
+    bool setStateLocal(string stateName, size_t scratchBytes = 0)
+    {
+        StateLocal layout;
+        layout.size = sizeof(T);
+        layout.alignment = alignof(T);
+        layout.scratchBytes = scratchBytes;
+        layout.type = &LocalType<T>::tag;
+        layout.construct = constructLocal<T>;
+        layout.destroy = is_trivially_destructible<T>::value ? nullptr : destroyLocal<T>;
+
+        return setStateLocalLayout(stateName, layout);
+    }
+
+    /**
+     * @brief Remove the local storage of a state.
+     * @param stateName The name of the state.
+     * @return True if the storage was removed successfully, false if the state was not found.
+     */
+    bool clearStateLocal(string stateName);
+
+    /**
+     * @brief Make room in the arena for scratch memory of states without local storage.
+     * @param scratchBytes The bytes any state may take with allocateInState() while it is active (including alignment padding).
+     *
+     * @warning Like setStateLocal(), growing the arena releases the storage of the active state and constructs it again.
+     */
+    void reserveStateScratch(size_t scratchBytes);
+
+    /**
+     * @brief Get the local storage of the active state.
+     * @return The storage, or nullptr if the active state has no local storage of type T.
+     */
+    template <typename T>
+    T *getStateLocal()
+    {
+        if (activeLocal == nullptr || activeLocalType != &LocalType<T>::tag)
+        {
+            return nullptr;
+        }
+
+        return static_cast<T *>(activeLocal);
+    }
+
+    /**
+     * @brief Allocate scratch memory that is released when the active state is left.
+     * @param size The number of bytes to allocate.
+     * @param alignment The alignment of the memory (a power of two).
+     * @return The memory, or nullptr if the arena is full.
+     *
+     * @note The arena never grows here: it only holds what setStateLocal() and reserveStateScratch() made room for,
+     * so without either every allocation fails.
+     * @warning No destructor is ever called for the memory, so only use it for trivially destructible data.
+     */
+    void *allocateInState(size_t size, size_t alignment = alignof(max_align_t))
+    {
+        return stateArena.allocate(size, alignment);
+    }
 };
 
+template <typename T>
+char StateManager::LocalType<T>::tag;
+
+#ifdef STATEMANAGER_INLINE_DISPATCH
+#include "StateManagerInline.hpp"
+#endif
+
 #endif // STATEMANAGER_HPP
@@ -0,0 +1,60 @@
+/**
+ * @brief The features compiled into StateManager.
+ * @author Honzik Schenk
+ *
+ * Every feature of StateManager that is checked on a tick or a transition
+ * can be compiled out. Define STATEMANAGER_FEATURES to the features to keep
+ * (ex: -DSTATEMANAGER_FEATURES=0 for the core alone, or
+ * -DSTATEMANAGER_FEATURES=STATEMANAGER_FEATURE_METRICS). The checks of the
+ * other features become constant false conditions, so run(), transition()
+ * and entering a state leave no code behind for them. The functions setting
+ * them up are still declared, but report failure (or do nothing if they
+ * return nothing). Without a definition, every feature is compiled in.
+ *
+ * @warning STATEMANAGER_FEATURES has to be defined the same way for every
+ * file of a program, including StateManager.cpp.
+ */
+
+#ifndef STATEMANAGERFEATURES_HPP
+#define STATEMANAGERFEATURES_HPP
+
+// Counters of ticks, transitions, guard calls and time in state (setMetrics()).
+#define STATEMANAGER_FEATURE_METRICS 0x001
+
+// Dwell time histograms (setDwellHistograms()).
+#define STATEMANAGER_FEATURE_DWELL_HISTOGRAMS 0x002
+
+// Hardware performance counters (setPerfCounters()).
+#define STATEMANAGER_FEATURE_PERF_COUNTERS 0x004
+
+// Transition hysteresis (setTransitionHysteresis()).
+#define STATEMANAGER_FEATURE_HYSTERESIS 0x008
+
+// Oscillation detection (setOscillationDetection()).
+#define STATEMANAGER_FEATURE_OSCILLATION_DETECTION 0x010
+
+// Blackboard edge triggers (addEdgeTrigger()).
+#define STATEMANAGER_FEATURE_EDGE_TRIGGERS 0x020
+
+// Declared transitions, limiting the states a state can be entered from (addTransition()).
+#define STATEMANAGER_FEATURE_DECLARED_TRANSITIONS 0x040
+
+// Global transitions (addGlobalTransition()).
+#define STATEMANAGER_FEATURE_GLOBAL_TRANSITIONS 0x080
+
+// Composite states and history (setParentState(), setInitialState(), setHistory()).
+#define STATEMANAGER_FEATURE_HIERARCHY 0x100
+
+// Deferred events (deferEvent()).
+#define STATEMANAGER_FEATURE_DEFERRAL 0x200
+
+// State-local storage (setStateLocalLayout(), reserveStateScratch()).
+#define STATEMANAGER_FEATURE_STATE_LOCAL 0x400
+
+#define STATEMANAGER_ALL_FEATURES 0x7FF
+
+#ifndef STATEMANAGER_FEATURES
+#define STATEMANAGER_FEATURES STATEMANAGER_ALL_FEATURES
+#endif
+
+#endif // STATEMANAGERFEATURES_HPP
@@ -0,0 +1,106 @@
+/**
+ * @brief The definitions of the functions called on every tick of a StateManager.
+ * @author Honzik Schenk
+ *
+ * run() and transition() are defined here instead of in StateManager.cpp.
+ * Normally this file is only included by StateManager.cpp. When the whole
+ * program is built with STATEMANAGER_INLINE_DISPATCH defined, StateManager.hpp
+ * includes it instead and the functions become inline, so a tick can be
+ * inlined into the caller's control loop rather than being an opaque call
+ * into another translation unit.
+ *
+ * @warning STATEMANAGER_INLINE_DISPATCH has to be defined (or not) the same
+ * way for every file of a program, including StateManager.cpp.
+ */
+
+#ifndef STATEMANAGERINLINE_HPP
+#define STATEMANAGERINLINE_HPP
+
+#include <string>
+
+#include "StateManager.hpp"
+
+#ifdef STATEMANAGER_INLINE_DISPATCH
+#define STATEMANAGER_INLINE inline
+#else
+#define STATEMANAGER_INLINE
+#endif
+
+using namespace std;
+
+STATEMANAGER_INLINE bool StateManager::run()
+{
+    if (withMetrics && metrics != nullptr)
+    {
+        metrics->increment(ticksMetric);
+    }
+
+    return activeState.stateFunction();
+}
+
+STATEMANAGER_INLINE bool StateManager::run(bool transitionToo)
+{
+    bool stateRan = run();
+
+    if (transitionToo)
+    {
+        transition();
+    }
+
+    return stateRan;
+}
+
+STATEMANAGER_INLINE bool StateManager::transition()
+{
+    if (withGlobalTransitions && !globalTransitions.empty() && takeGlobalTransition())
+    {
+        return true;
+    }
+
+    if (withEdgeTriggers && !pendingTriggers.empty() && takeEdgeTrigger())
+    {
+        return true;
+    }
+
+    for (auto &s : states)
+    {
+        if (activeState == s)
+        {
+            continue;
+        }
+
+        if (withDeclaredTransitions && s.id < declaredSources.size() && !declaredSources[s.id].empty() && !isDeclaredSource(s, activeState.id))
+        {
+            continue;
+        }
+
+        bool wantsToBecomeActive = s.transitionToState(activeState.stateName);
+
+        if (withMetrics && metrics != nullptr)
+        {
+            const StateMetricIds &ids = stateMetricIds(s);
+
+            metrics->increment(ids.guardCalls);
+
+            if (wantsToBecomeActive)
+            {
+                metrics->increment(ids.guardTrue);
+            }
+        }
+
+        if (withHysteresis && s.id < edgeHysteresis.size() && !edgeHysteresis[s.id].empty())
+        {
+            wantsToBecomeActive = debounce(s, wantsToBecomeActive);
+        }
+
+        if (wantsToBecomeActive)
+        {
+            enterState(s);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#endif // STATEMANAGERINLINE_HPP
@@ -0,0 +1,264 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "StateMetrics.hpp"
+
+using namespace std;
+
+namespace
+{
+    // Counters are laid out so that every shard starts on its own cache line.
+    const size_t cacheLineSize = 64;
+    const size_t cellsPerLine = cacheLineSize / sizeof(atomic<uint64_t>);
+}
+
+const StateMetrics::MetricId StateMetrics::invalidMetric;
+
+StateMetrics::StateMetrics(size_t maxMetrics, size_t shardCount)
+    : capacity(maxMetrics), shardCount(shardCount == 0 ? 1 : shardCount)
+{
+    // Round every shard up to a whole number of cache lines (plus one line of padding) so no two threads ever share a line.
+    shardStride = ((capacity + cellsPerLine - 1) / cellsPerLine + 1) * cellsPerLine;
+
+    size_t cellCount = shardStride * this->shardCount + cellsPerLine;
+
+    cellStorage = new atomic<uint64_t>[cellCount];
+
+    for (size_t i = 0; i < cellCount; i++)
+    {
+        cellStorage[i].store(0, memory_order_relaxed);
+    }
+
+    uintptr_t address = reinterpret_cast<uintptr_t>(cellStorage);
+    uintptr_t aligned = (address + cacheLineSize - 1) & ~static_cast<uintptr_t>(cacheLineSize - 1);
+
+    cells = cellStorage + (aligned - address) / sizeof(atomic<uint64_t>);
+
+    metrics.reserve(capacity);
+}
+
+StateMetrics::~StateMetrics()
+{
+    delete[] cellStorage;
+}
+
+size_t StateMetrics::threadShard()
+{
+    static atomic<size_t> nextShard(0);
+    static thread_local size_t shard = nextShard.fetch_add(1, memory_order_relaxed);
+
+    return shard;
+}
+
+StateMetrics::MetricId StateMetrics::addMetric(const string &name, const string &help, const string &labels, MetricType type)
+{
+    lock_guard<mutex> lock(registryMutex);
+
+    // Names cannot contain '{', so the key is unique for every name and labels.
+    string key = name + "{" + labels;
+    unordered_map<string, MetricId>::const_iterator found = idByKey.find(key);
+
+    if (found != idByKey.end())
+    {
+        return metrics[found->second].type == type ? found->second : invalidMetric;
+    }
+
+    if (metrics.size() >= capacity)
+    {
+        return invalidMetric;
+    }
+
+    Metric metric;
+    metric.name = name;
+    metric.help = help;
+    metric.labels = labels;
+    metric.type = type;
+
+    metrics.push_back(metric);
+    idByKey[key] = metrics.size() - 1;
+
+    return metrics.size() - 1;
+}
+
+StateMetrics::MetricId StateMetrics::addCounter(const string &name, const string &help, const string &labels)
+{
+    return addMetric(name, help, labels, Counter);
+}
+
+StateMetrics::MetricId StateMetrics::addGauge(const string &name, const string &help, const string &labels)
+{
+    return addMetric(name, help, labels, Gauge);
+}
+
+uint64_t StateMetrics::read(MetricId id) const
+{
+    if (id >= capacity)
+    {
+        return 0;
+    }
+
+    MetricType type;
+
+    {
+        lock_guard<mutex> lock(registryMutex);
+
+        if (id >= metrics.size())
+        {
+            return 0;
+        }
+
+        type = metrics[id].type;
+    }
+
+    if (type == Gauge)
+    {
+        return shardFor(0)[id].load(memory_order_relaxed);
+    }
+
+    uint64_t total = 0;
+
+    for (size_t shard = 0; shard < shardCount; shard++)
+    {
+        total += shardFor(shard)[id].load(memory_order_relaxed);
+    }
+
+    return total;
+}
+
+size_t StateMetrics::size() const
+{
+    lock_guard<mutex> lock(registryMutex);
+
+    return metrics.size();
+}
+
+string StateMetrics::label(const string &key, const string &value)
+{
+    string escaped;
+    escaped.reserve(value.size());
+
+    for (char c : value)
+    {
+        if (c == '\\' || c == '"')
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (c == '\n')
+        {
+            escaped += "\\n";
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+
+    return key + "=\"" + escaped + "\"";
+}
+
+string StateMetrics::toPrometheus() const
+{
+    vector<Metric> snapshot;
+
+    {
+        lock_guard<mutex> lock(registryMutex);
+        snapshot = metrics;
+    }
+
+    // Prometheus wants every sample of a metric family grouped under a single HELP/TYPE header.
+    // Families are written in the order they were first registered.
+    unordered_map<string, size_t> familyByName;
+    vector<vector<size_t>> families;
+
+    for (size_t i = 0; i < snapshot.size(); i++)
+    {
+        unordered_map<string, size_t>::iterator found = familyByName.find(snapshot[i].name);
+
+        if (found == familyByName.end())
+        {
+            found = familyByName.insert(make_pair(snapshot[i].name, families.size())).first;
+            families.push_back(vector<size_t>());
+        }
+
+        families[found->second].push_back(i);
+    }
+
+    ostringstream out;
+
+    for (auto &family : families)
+    {
+        const Metric &first = snapshot[family.front()];
+
+        out << "# HELP " << first.name << " " << first.help << "\n";
+        out << "# TYPE " << first.name << " " << (first.type == Counter ? "counter" : "gauge") << "\n";
+
+        for (size_t j : family)
+        {
+            out << snapshot[j].name;
+
+            if (!snapshot[j].labels.empty())
+            {
+                out << "{" << snapshot[j].labels << "}";
+            }
+
+            if (snapshot[j].type == Gauge)
+            {
+                out << " " << static_cast<int64_t>(shardFor(0)[j].load(memory_order_relaxed)) << "\n";
+            }
+            else
+            {
+                uint64_t total = 0;
+
+                for (size_t shard = 0; shard < shardCount; shard++)
+                {
+                    total += shardFor(shard)[j].load(memory_order_relaxed);
+                }
+
+                out << " " << total << "\n";
+            }
+        }
+    }
+
+    return out.str();
+}
+
+bool StateMetrics::exportToFile(const string &path) const
+{
+    string temporaryPath = path + ".tmp";
+
+    {
+        ofstream file(temporaryPath.c_str(), ios::out | ios::trunc);
+
+        if (!file)
+        {
+            return false;
+        }
+
+        file << toPrometheus();
+
+        if (!file)
+        {
+            return false;
+        }
+    }
+
+    return rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
+
+void StateMetrics::exportTo(void (*exporter)(const string &text)) const
+{
+    if (exporter == nullptr)
+    {
+        return;
+    }
+
+    exporter(toPrometheus());
+}
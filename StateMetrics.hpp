@@ -0,0 +1,178 @@
+/**
+ * @brief A lock-free metrics registry for state managers.
+ * @author Honzik Schenk
+ *
+ * StateMetrics stores counters and gauges in per-thread, cache-line-padded
+ * shards. Incrementing a metric never takes a lock: every thread writes to its
+ * own shard and the shards are only summed up when the metrics are read or
+ * exported. The registry can be dumped in the Prometheus text format to a file
+ * or to a callback, so it can be scraped without touching the control thread.
+ */
+
+#ifndef STATEMETRICS_HPP
+#define STATEMETRICS_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+class StateMetrics
+{
+public:
+    typedef size_t MetricId;
+
+    enum MetricType
+    {
+        Counter,
+        Gauge
+    };
+
+    /**
+     * @brief Returned by the add functions when the registry is full.
+     */
+    static const MetricId invalidMetric = static_cast<MetricId>(-1);
+
+    /**
+     * @brief Create a metrics registry.
+     * @param maxMetrics The maximum number of counters and gauges that can be registered.
+     * @param shardCount The number of per-thread shards counters are spread over.
+     *
+     * @note All memory is allocated up front, so registering and incrementing metrics never reallocates.
+     */
+    StateMetrics(size_t maxMetrics = 1024, size_t shardCount = 16);
+
+    ~StateMetrics();
+
+    /**
+     * @brief Register a counter (or find the already registered one).
+     * @param name The Prometheus name of the metric (ex: statemanager_ticks_total).
+     * @param help The help text exported with the metric.
+     * @param labels The labels of the metric, already formatted (ex: machine="arm",state="Idle").
+     * @return The id of the counter, or invalidMetric if the registry is full.
+     *
+     * @note Registering takes a lock, so it should be done outside of the control loop where possible.
+     */
+    MetricId addCounter(const string &name, const string &help, const string &labels = "");
+
+    /**
+     * @brief Register a gauge (or find the already registered one).
+     * @param name The Prometheus name of the metric (ex: statemanager_queue_depth).
+     * @param help The help text exported with the metric.
+     * @param labels The labels of the metric, already formatted.
+     * @return The id of the gauge, or invalidMetric if the registry is full.
+     */
+    MetricId addGauge(const string &name, const string &help, const string &labels = "");
+
+    /**
+     * @brief Increment a counter. Lock-free and safe to call from any thread.
+     * @param id The id of the counter.
+     * @param amount The amount to add.
+     */
+    void increment(MetricId id, uint64_t amount = 1)
+    {
+        if (id >= capacity)
+        {
+            return;
+        }
+
+        shardFor(threadShard())[id].fetch_add(amount, memory_order_relaxed);
+    }
+
+    /**
+     * @brief Set the value of a gauge. Lock-free and safe to call from any thread.
+     * @param id The id of the gauge.
+     * @param value The new value.
+     */
+    void set(MetricId id, int64_t value)
+    {
+        if (id >= capacity)
+        {
+            return;
+        }
+
+        shardFor(0)[id].store(static_cast<uint64_t>(value), memory_order_relaxed);
+    }
+
+    /**
+     * @brief Read the current value of a metric by summing up all shards.
+     * @param id The id of the metric.
+     * @return The value of the metric, or 0 if the id is not registered.
+     *
+     * @note Gauges are returned as their two's complement representation.
+     */
+    uint64_t read(MetricId id) const;
+
+    /**
+     * @brief Get the number of registered metrics.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Format all registered metrics in the Prometheus text exposition format.
+     * @return The formatted metrics.
+     */
+    string toPrometheus() const;
+
+    /**
+     * @brief Write all registered metrics in the Prometheus text format to a file.
+     * @param path The file to write to. It is replaced atomically through a temporary file.
+     * @return True if the file was written successfully.
+     */
+    bool exportToFile(const string &path) const;
+
+    /**
+     * @brief Pass all registered metrics in the Prometheus text format to a callback.
+     * @param exporter The function to call with the formatted metrics.
+     */
+    void exportTo(void (*exporter)(const string &text)) const;
+
+    /**
+     * @brief Format a single label for use in the labels of a metric.
+     * @param key The name of the label.
+     * @param value The value of the label. Quotes, backslashes and newlines are escaped.
+     * @return The formatted label (ex: state="Idle").
+     */
+    static string label(const string &key, const string &value);
+
+private:
+    struct Metric
+    {
+        string name;
+        string help;
+        string labels;
+        MetricType type;
+    };
+
+    MetricId addMetric(const string &name, const string &help, const string &labels, MetricType type);
+
+    static size_t threadShard();
+
+    atomic<uint64_t> *shardFor(size_t shard) const
+    {
+        return cells + (shard % shardCount) * shardStride;
+    }
+
+    size_t capacity;
+    size_t shardCount;
+    size_t shardStride;
+
+    atomic<uint64_t> *cellStorage;
+    atomic<uint64_t> *cells;
+
+    mutable mutex registryMutex;
+    vector<Metric> metrics;
+
+    // The id of every metric by its name and labels, so registering does not scan the registry.
+    unordered_map<string, MetricId> idByKey;
+
+    StateMetrics(const StateMetrics &) = delete;
+    StateMetrics &operator=(const StateMetrics &) = delete;
+};
+
+#endif // STATEMETRICS_HPP
@@ -0,0 +1,152 @@
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "StatePerfCounters.hpp"
+
+using namespace std;
+
+#ifdef __linux__
+
+namespace
+{
+    int openCounter(uint64_t config, int groupFd)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.disabled = groupFd == -1 ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0));
+    }
+}
+
+StatePerfCounters::StatePerfCounters()
+{
+    const uint64_t configs[CounterCount] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+
+    openedCount = 0;
+
+    for (int i = 0; i < CounterCount; i++)
+    {
+        fds[i] = -1;
+        groupIndex[i] = -1;
+    }
+
+    // The cycle counter leads the group, so all counters are scheduled (and read) together.
+    for (int i = 0; i < CounterCount; i++)
+    {
+        fds[i] = openCounter(configs[i], i == Cycles ? -1 : fds[Cycles]);
+
+        if (fds[i] == -1)
+        {
+            if (i == Cycles)
+            {
+                return;
+            }
+
+            continue;
+        }
+
+        groupIndex[i] = openedCount++;
+    }
+
+    ioctl(fds[Cycles], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds[Cycles], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+StatePerfCounters::~StatePerfCounters()
+{
+    for (int i = CounterCount - 1; i >= 0; i--)
+    {
+        if (fds[i] != -1)
+        {
+            close(fds[i]);
+        }
+    }
+}
+
+bool StatePerfCounters::available() const
+{
+    return fds[Cycles] != -1;
+}
+
+bool StatePerfCounters::read(Sample &sample) const
+{
+    sample = Sample();
+
+    if (!available())
+    {
+        return false;
+    }
+
+    // Layout of a PERF_FORMAT_GROUP read: the number of counters followed by their values.
+    uint64_t values[1 + CounterCount];
+
+    ssize_t size = ::read(fds[Cycles], values, sizeof(values));
+
+    if (size < static_cast<ssize_t>(sizeof(uint64_t) * (1 + openedCount)))
+    {
+        return false;
+    }
+
+    uint64_t *fields[CounterCount] = {&sample.cycles, &sample.instructions, &sample.cacheMisses, &sample.branchMisses};
+
+    for (int i = 0; i < CounterCount; i++)
+    {
+        if (groupIndex[i] != -1)
+        {
+            *fields[i] = values[1 + groupIndex[i]];
+        }
+    }
+
+    return true;
+}
+
+#else
+
+StatePerfCounters::StatePerfCounters()
+{
+    openedCount = 0;
+
+    for (int i = 0; i < CounterCount; i++)
+    {
+        fds[i] = -1;
+        groupIndex[i] = -1;
+    }
+}
+
+StatePerfCounters::~StatePerfCounters()
+{
+}
+
+bool StatePerfCounters::available() const
+{
+    return false;
+}
+
+bool StatePerfCounters::read(Sample &sample) const
+{
+    sample = Sample();
+
+    return false;
+}
+
+#endif
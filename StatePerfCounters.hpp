@@ -0,0 +1,75 @@
+/**
+ * @brief Hardware performance counters for attributing work to states.
+ * @author Honzik Schenk
+ *
+ * StatePerfCounters opens a group of Linux perf events (cycles, instructions,
+ * cache misses and branch misses) counting the calling thread in user space.
+ * When perf events are not available (other platforms, containers, a strict
+ * perf_event_paranoid setting, ...) the counters are simply unavailable and
+ * every read returns zeros, so callers never have to special case it.
+ */
+
+#ifndef STATEPERFCOUNTERS_HPP
+#define STATEPERFCOUNTERS_HPP
+
+#include <cstdint>
+
+using namespace std;
+
+class StatePerfCounters
+{
+public:
+    struct Sample
+    {
+        uint64_t cycles;
+        uint64_t instructions;
+        uint64_t cacheMisses;
+        uint64_t branchMisses;
+
+        Sample() : cycles(0), instructions(0), cacheMisses(0), branchMisses(0) {}
+    };
+
+    /**
+     * @brief Open the performance counters for the calling thread.
+     *
+     * @warning Only the thread that created the counters is measured.
+     */
+    StatePerfCounters();
+
+    ~StatePerfCounters();
+
+    /**
+     * @brief Check if the performance counters could be opened.
+     * @return True if at least the cycle counter is available.
+     */
+    bool available() const;
+
+    /**
+     * @brief Read the current totals of all counters.
+     * @param sample The sample to fill in. Counters that are unavailable are set to 0.
+     * @return True if the counters were read successfully.
+     */
+    bool read(Sample &sample) const;
+
+private:
+    enum Counter
+    {
+        Cycles,
+        Instructions,
+        CacheMisses,
+        BranchMisses,
+        CounterCount
+    };
+
+    int fds[CounterCount];
+
+    // Position of every counter in the group read, or -1 if it could not be opened.
+    int groupIndex[CounterCount];
+
+    int openedCount;
+
+    StatePerfCounters(const StatePerfCounters &) = delete;
+    StatePerfCounters &operator=(const StatePerfCounters &) = delete;
+};
+
+#endif // STATEPERFCOUNTERS_HPP
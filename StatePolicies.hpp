@@ -0,0 +1,211 @@
+/**
+ * @brief Policies configuring a BasicStateManager at compile time.
+ * @author Honzik Schenk
+ *
+ * Every feature of BasicStateManager that costs something on a tick is a
+ * policy: threading (a lock around every call), instrumentation (counters),
+ * storage (a growing vector or a fixed inline array) and the type of the state
+ * and transition functions. The policies that disable a feature are empty
+ * classes with empty inline functions, so they leave no code and no data in
+ * the state manager.
+ */
+
+#ifndef STATEPOLICIES_HPP
+#define STATEPOLICIES_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief No locking: the state manager is only used from one thread.
+ */
+struct SingleThreaded
+{
+    struct Lock
+    {
+        explicit Lock(SingleThreaded &) {}
+    };
+};
+
+/**
+ * @brief Every call takes a mutex, so the state manager can be used from several threads.
+ *
+ * @warning State and transition functions run with the mutex held, so they must not call the state manager.
+ */
+struct MultiThreaded
+{
+    struct Lock
+    {
+        explicit Lock(MultiThreaded &threading) : guard(threading.stateMutex) {}
+
+        lock_guard<mutex> guard;
+    };
+
+    mutex stateMutex;
+};
+
+/**
+ * @brief Nothing is counted.
+ */
+struct NoInstrumentation
+{
+    void onTick() {}
+
+    void onGuard(bool) {}
+
+    void onTransition(size_t, size_t) {}
+};
+
+/**
+ * @brief Count ticks, guard calls (and how many returned true) and transitions.
+ */
+struct CountingInstrumentation
+{
+    uint64_t ticks;
+    uint64_t guardCalls;
+    uint64_t guardTrue;
+    uint64_t transitions;
+
+    CountingInstrumentation() : ticks(0), guardCalls(0), guardTrue(0), transitions(0) {}
+
+    void onTick()
+    {
+        ticks++;
+    }
+
+    void onGuard(bool wantsToBecomeActive)
+    {
+        guardCalls++;
+        guardTrue += wantsToBecomeActive ? 1 : 0;
+    }
+
+    void onTransition(size_t, size_t)
+    {
+        transitions++;
+    }
+};
+
+/**
+ * @brief States are kept in a vector, so any number of states can be added.
+ */
+struct DynamicStorage
+{
+    template <typename T>
+    class Container
+    {
+    public:
+        size_t size() const
+        {
+            return items.size();
+        }
+
+        bool full() const
+        {
+            return false;
+        }
+
+        void push_back(const T &item)
+        {
+            items.push_back(item);
+        }
+
+        void erase(size_t index)
+        {
+            items.erase(items.begin() + index);
+        }
+
+        T &operator[](size_t index)
+        {
+            return items[index];
+        }
+
+        const T &operator[](size_t index) const
+        {
+            return items[index];
+        }
+
+    private:
+        vector<T> items;
+    };
+};
+
+/**
+ * @brief States are kept in an array inside the state manager, so it never allocates for them.
+ * @tparam Capacity The maximum number of states.
+ */
+template <size_t Capacity>
+struct FixedStorage
+{
+    template <typename T>
+    class Container
+    {
+    public:
+        Container() : count(0) {}
+
+        size_t size() const
+        {
+            return count;
+        }
+
+        bool full() const
+        {
+            return count == Capacity;
+        }
+
+        void push_back(const T &item)
+        {
+            items[count++] = item;
+        }
+
+        void erase(size_t index)
+        {
+            for (size_t i = index + 1; i < count; i++)
+            {
+                items[i - 1] = items[i];
+            }
+
+            items[--count] = T();
+        }
+
+        T &operator[](size_t index)
+        {
+            return items[index];
+        }
+
+        const T &operator[](size_t index) const
+        {
+            return items[index];
+        }
+
+    private:
+        array<T, Capacity> items;
+        size_t count;
+    };
+};
+
+/**
+ * @brief State and transition functions are plain function pointers (the cheapest call).
+ */
+struct FunctionPointerCallbacks
+{
+    typedef bool (*StateFunction)();
+    typedef bool (*TransitionFunction)(string activeState);
+};
+
+/**
+ * @brief State and transition functions are std::function, so they can capture state (ex: lambdas with captures).
+ */
+struct StdFunctionCallbacks
+{
+    typedef function<bool()> StateFunction;
+    typedef function<bool(string activeState)> TransitionFunction;
+};
+
+#endif // STATEPOLICIES_HPP
@@ -1,5 +1,5 @@
 // NOTE: This is an example of how to use the StateManager library.
-// To run with gcc, use the following command: g++ -std=c++11 -o StateManagerTest Test.cpp StateManager.cpp && ./StateManagerTest
+// To run with gcc, use the following command: g++ -std=c++11 -pthread -o StateManagerTest Test.cpp StateManager.cpp StateArena.cpp StateBlackboard.cpp StateDefinition.cpp StateDefinitionDomain.cpp StateDfa.cpp StateDispatchTable.cpp StateEventQueue.cpp StateFleet.cpp StateGraph.cpp StateHistogram.cpp StateMachine.cpp StateMetrics.cpp StatePerfCounters.cpp && ./StateManagerTest
 #include <iostream>
 #include <string>
 
@@ -0,0 +1,86 @@
+#include <cstdint>
+#include <string>
+
+#include "BasicStateManager.hpp"
+#include "TestFramework.hpp"
+
+using namespace std;
+
+namespace
+{
+    bool always(string)
+    {
+        return true;
+    }
+
+    bool running()
+    {
+        return true;
+    }
+}
+
+TEST(BasicStateManager, RunsAndTransitions)
+{
+    BasicStateManager<SingleThreaded, CountingInstrumentation> stateManager;
+
+    CHECK(!stateManager.run(true));
+    CHECK(stateManager.addState("idle"));
+    CHECK(stateManager.addState("busy"));
+    CHECK(!stateManager.addState("idle"));
+    stateManager.setStateFunction("busy", running);
+    stateManager.setTransitionToState("busy", always);
+
+    CHECK(stateManager.transition());
+    CHECK_EQUAL(string("busy"), stateManager.getActiveStateName());
+    CHECK(stateManager.run(true));
+
+    CHECK_EQUAL(uint64_t(2), stateManager.getInstrumentation().ticks);
+    CHECK_EQUAL(uint64_t(1), stateManager.getInstrumentation().transitions);
+}
+
+TEST(BasicStateManager, RemoveKeepsActiveState)
+{
+    BasicStateManager<> stateManager;
+    stateManager.addState("a");
+    stateManager.addState("b");
+    stateManager.transition("b");
+
+    CHECK(stateManager.removeState("a"));
+    CHECK_EQUAL(string("b"), stateManager.getActiveStateName());
+
+    CHECK(stateManager.removeState("b"));
+    CHECK_EQUAL(string(), stateManager.getActiveStateName());
+    CHECK(!stateManager.run());
+}
+
+TEST(BasicStateManager, FixedStorageAndNarrowIds)
+{
+    BasicStateManager<SingleThreaded, NoInstrumentation, FixedStorage<2>, FunctionPointerCallbacks, uint8_t> fixed;
+
+    CHECK(fixed.addState("a"));
+    CHECK(fixed.addState("b"));
+    CHECK(!fixed.addState("c"));
+
+    // The largest id is reserved for "no state".
+    BasicStateManager<SingleThreaded, NoInstrumentation, DynamicStorage, FunctionPointerCallbacks, uint8_t> narrow;
+
+    for (int i = 0; i < 300; i++)
+    {
+        narrow.addState(to_string(i));
+    }
+
+    CHECK_EQUAL(size_t(255), narrow.size());
+}
+
+TEST(BasicStateManager, StdFunctionCallbacksCapture)
+{
+    BasicStateManager<SingleThreaded, NoInstrumentation, DynamicStorage, StdFunctionCallbacks> stateManager;
+    int runs = 0;
+
+    stateManager.addState("idle");
+    stateManager.setStateFunction("idle", [&runs]() { return ++runs > 0; });
+    stateManager.transition("idle");
+
+    CHECK(stateManager.run());
+    CHECK_EQUAL(1, runs);
+}
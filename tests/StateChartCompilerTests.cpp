@@ -0,0 +1,48 @@
+#include <string>
+
+#include "StateManager.hpp"
+#include "TestFramework.hpp"
+#include "Turnstile.hpp"
+
+using namespace std;
+
+namespace Turnstile
+{
+    bool isLocked(string)
+    {
+        return false;
+    }
+
+    bool unlock()
+    {
+        return true;
+    }
+
+    bool pass()
+    {
+        return true;
+    }
+}
+
+// The tables are constant expressions, so events with known ids are looked up at compile time.
+static_assert(Turnstile::onEvent(Turnstile::Locked, Turnstile::coin) == Turnstile::Open, "coin opens the turnstile");
+static_assert(Turnstile::onEvent(Turnstile::Passing, Turnstile::push) == Turnstile::Locked, "push is inherited from Open");
+static_assert(Turnstile::initialOf[Turnstile::Open] == Turnstile::Unlocking, "Open starts in Unlocking");
+
+TEST(StateChartCompiler, GeneratedHeaderConfiguresStateManager)
+{
+    CHECK_EQUAL(size_t(4), Turnstile::stateCount);
+    CHECK_EQUAL(string("Unlocking"), string(Turnstile::stateNames[Turnstile::Unlocking]));
+    CHECK_EQUAL(int(Turnstile::Open), int(Turnstile::parentOf[Turnstile::Passing]));
+
+    StateManager stateManager;
+    CHECK(Turnstile::configure(stateManager));
+
+    // Open was configured before its children were declared.
+    stateManager.transition("Open");
+    CHECK_EQUAL(string("Unlocking"), stateManager.getActiveStateName());
+
+    // Unlocking defers push, but Open handles it.
+    CHECK(stateManager.dispatchEvent(Turnstile::push));
+    CHECK_EQUAL(string("Locked"), stateManager.getActiveStateName());
+}
@@ -0,0 +1,292 @@
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "StateDfa.hpp"
+#include "TestFramework.hpp"
+
+using namespace std;
+
+namespace
+{
+    struct Counts
+    {
+        size_t strings;
+        size_t lines;
+        vector<size_t> stringEnds;
+
+        Counts() : strings(0), lines(0) {}
+    };
+
+    const uint8_t *bufferStart = nullptr;
+
+    void stringEnded(void *context, const uint8_t *position)
+    {
+        Counts *counts = static_cast<Counts *>(context);
+
+        counts->strings++;
+        counts->stringEnds.push_back(static_cast<size_t>(position - bufferStart));
+    }
+
+    void lineEnded(void *context, const uint8_t *)
+    {
+        static_cast<Counts *>(context)->lines++;
+    }
+
+    // Quoted strings with backslash escapes, and lines outside of them.
+    void buildScanner(StateDfa &dfa)
+    {
+        dfa.addState("outside");
+        dfa.addState("string");
+        dfa.addState("escape");
+        dfa.addTransition("outside", '"', "string");
+        dfa.addTransition("outside", '\n', "outside", lineEnded);
+        dfa.addTransition("string", '"', "outside", stringEnded);
+        dfa.addTransition("string", '\\', "escape");
+        dfa.addTransition("escape", 0, 255, "string");
+    }
+
+    // The same scanner written by hand, to compare with.
+    void scanByHand(const vector<uint8_t> &data, Counts &counts, int &state)
+    {
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            uint8_t byte = data[i];
+
+            if (state == 0)
+            {
+                state = byte == '"' ? 1 : 0;
+                counts.lines += byte == '\n' ? 1 : 0;
+            }
+            else if (state == 1)
+            {
+                if (byte == '"')
+                {
+                    state = 0;
+                    counts.strings++;
+                    counts.stringEnds.push_back(i);
+                }
+                else if (byte == '\\')
+                {
+                    state = 2;
+                }
+            }
+            else
+            {
+                state = 1;
+            }
+        }
+    }
+}
+
+TEST(StateDfa, CompilesByteClasses)
+{
+    StateDfa dfa;
+    buildScanner(dfa);
+
+    CHECK(dfa.compile());
+
+    // '"', '\\', '\n' and every other byte.
+    CHECK_EQUAL(size_t(4), dfa.getClassCount());
+    CHECK_EQUAL(size_t(3 * 4 * sizeof(uint32_t)), dfa.getTableBytes());
+    CHECK_EQUAL(string("outside"), dfa.getActiveStateName());
+}
+
+TEST(StateDfa, MatchesHandWrittenScanner)
+{
+    mt19937 random(1234);
+    const char alphabet[] = {'a', 'b', ' ', '"', '\\', '\n'};
+    vector<uint8_t> data(200000);
+
+    for (auto &byte : data)
+    {
+        // Mostly plain bytes, so long runs are skipped ahead.
+        byte = random() % 8 != 0 ? 'a' : static_cast<uint8_t>(alphabet[random() % sizeof(alphabet)]);
+    }
+
+    StateDfa dfa;
+    buildScanner(dfa);
+
+    Counts counts;
+    dfa.setActionContext(&counts);
+    bufferStart = data.data();
+
+    // Feed in chunks of varying size: the state carries over between calls.
+    size_t offset = 0;
+
+    while (offset < data.size())
+    {
+        size_t chunk = random() % 100;
+        chunk = chunk > data.size() - offset ? data.size() - offset : chunk;
+
+        dfa.feed(data.data() + offset, chunk);
+        offset += chunk;
+    }
+
+    Counts expected;
+    int state = 0;
+    scanByHand(data, expected, state);
+
+    CHECK_EQUAL(expected.strings, counts.strings);
+    CHECK_EQUAL(expected.lines, counts.lines);
+    CHECK(expected.stringEnds == counts.stringEnds);
+    CHECK_EQUAL(size_t(state), dfa.getActiveState());
+}
+
+TEST(StateDfa, ResetAndRecompile)
+{
+    StateDfa dfa;
+    buildScanner(dfa);
+
+    const uint8_t text[] = "\"open";
+    dfa.feed(text, sizeof(text) - 1);
+    CHECK_EQUAL(string("string"), dfa.getActiveStateName());
+
+    // Adding a state recompiles on the next feed, keeping the active state.
+    dfa.addState("comment");
+    dfa.addTransition("outside", '#', "comment");
+    dfa.feed(text, 0);
+    CHECK_EQUAL(string("string"), dfa.getActiveStateName());
+
+    dfa.reset();
+    CHECK_EQUAL(string("outside"), dfa.getActiveStateName());
+
+    const uint8_t comment[] = "# everything is ignored \"";
+    dfa.feed(comment, sizeof(comment) - 1);
+    CHECK_EQUAL(string("comment"), dfa.getActiveStateName());
+}
+
+TEST(StateDfa, InterleavedStreamsMatchSingleStream)
+{
+    mt19937 random(99);
+    const char alphabet[] = {'a', '"', '\\', '\n'};
+    const size_t streamCount = 13;
+
+    StateDfa dfa;
+    buildScanner(dfa);
+
+    vector<vector<uint8_t>> inputs(streamCount);
+    vector<Counts> counts(streamCount);
+    vector<StateDfa::Stream> streams(streamCount);
+
+    for (size_t i = 0; i < streamCount; i++)
+    {
+        // Streams of different lengths, so some run on after the lockstep part.
+        inputs[i].resize(1000 + random() % 5000);
+
+        for (auto &byte : inputs[i])
+        {
+            byte = static_cast<uint8_t>(alphabet[random() % sizeof(alphabet)]);
+        }
+
+        streams[i].data = inputs[i].data();
+        streams[i].size = inputs[i].size();
+        streams[i].context = &counts[i];
+    }
+
+    dfa.feed(streams.data(), streams.size());
+
+    for (size_t i = 0; i < streamCount; i++)
+    {
+        Counts expected;
+        int state = 0;
+        scanByHand(inputs[i], expected, state);
+
+        CHECK_EQUAL(expected.strings, counts[i].strings);
+        CHECK_EQUAL(expected.lines, counts[i].lines);
+        CHECK_EQUAL(size_t(state), streams[i].state);
+        CHECK_EQUAL(size_t(0), streams[i].size);
+        CHECK(streams[i].data == inputs[i].data() + inputs[i].size());
+    }
+}
+
+namespace
+{
+    void recordPosition(void *context, const uint8_t *position)
+    {
+        static_cast<vector<const uint8_t *> *>(context)->push_back(position);
+    }
+
+    void recordOtherPosition(void *context, const uint8_t *position)
+    {
+        static_cast<vector<const uint8_t *> *>(context)->push_back(position + 1000000);
+    }
+}
+
+TEST(StateDfa, MinimizeMergesEquivalentStates)
+{
+    StateDfa dfa;
+    buildScanner(dfa);
+
+    // A second kind of string that behaves exactly like the first one.
+    dfa.addState("otherString");
+    dfa.addState("otherEscape");
+    dfa.addTransition("outside", '\'', "otherString");
+    dfa.addTransition("otherString", '"', "outside", stringEnded);
+    dfa.addTransition("otherString", '\\', "otherEscape");
+    dfa.addTransition("otherEscape", 0, 255, "otherString");
+
+    StateDfa::MinimizeReport report = dfa.minimize();
+
+    CHECK_EQUAL(size_t(5), report.statesBefore);
+    CHECK_EQUAL(size_t(3), report.statesAfter);
+    CHECK(report.tableBytesAfter < report.tableBytesBefore);
+    CHECK_EQUAL(size_t(3), dfa.size());
+
+    // The merged names still refer to their states.
+    CHECK(dfa.setInitialState("otherString"));
+    dfa.reset();
+    CHECK_EQUAL(string("string"), dfa.getActiveStateName());
+}
+
+TEST(StateDfa, MinimizeKeepsBehavior)
+{
+    mt19937 random(7);
+
+    for (int round = 0; round < 20; round++)
+    {
+        // Random machines over a few byte values, with two actions, have plenty of equivalent states.
+        StateDfa original;
+        StateDfa minimized;
+        size_t stateCount = 2 + random() % 40;
+
+        for (size_t s = 0; s < stateCount; s++)
+        {
+            original.addState(to_string(s));
+            minimized.addState(to_string(s));
+        }
+
+        for (size_t s = 0; s < stateCount; s++)
+        {
+            for (uint8_t byte = 0; byte < 4; byte++)
+            {
+                string to = to_string(random() % stateCount);
+                unsigned kind = random() % 8;
+                StateDfa::Action action = kind == 0 ? recordPosition : kind == 1 ? recordOtherPosition : nullptr;
+
+                original.addTransition(to_string(s), byte, to, action);
+                minimized.addTransition(to_string(s), byte, to, action);
+            }
+        }
+
+        StateDfa::MinimizeReport report = minimized.minimize();
+        CHECK(report.statesAfter <= report.statesBefore);
+
+        vector<uint8_t> input(5000);
+
+        for (auto &byte : input)
+        {
+            byte = static_cast<uint8_t>(random() % 5);
+        }
+
+        vector<const uint8_t *> expected;
+        vector<const uint8_t *> actual;
+        original.setActionContext(&expected);
+        minimized.setActionContext(&actual);
+        original.feed(input.data(), input.size());
+        minimized.feed(input.data(), input.size());
+
+        CHECK(expected == actual);
+    }
+}
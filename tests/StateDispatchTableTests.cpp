@@ -0,0 +1,123 @@
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "StateDefinitionDomain.hpp"
+#include "StateDispatchTable.hpp"
+#include "StateMachine.hpp"
+#include "StateManager.hpp"
+#include "TestFramework.hpp"
+
+using namespace std;
+
+TEST(StateDispatchTable, DenseWhenWellFilled)
+{
+    StateDispatchTable table;
+    table.reset(4, 3);
+
+    for (size_t state = 0; state < 4; state++)
+    {
+        table.set(state, state % 3, static_cast<uint32_t>(state + 1));
+    }
+
+    CHECK(!table.set(4, 0, 1));
+    CHECK(!table.set(0, 3, 1));
+
+    // Later entries replace earlier ones.
+    table.set(0, 0, 7);
+    table.compile();
+
+    CHECK(table.getLayout() == StateDispatchTable::Dense);
+    CHECK_EQUAL(size_t(4), table.getEntryCount());
+    CHECK_EQUAL(table.getDenseBytes(), table.getTableBytes());
+    CHECK_EQUAL(uint32_t(7), table.get(0, 0));
+    CHECK_EQUAL(uint32_t(4), table.get(3, 0));
+    CHECK_EQUAL(StateDispatchTable::noTarget, table.get(3, 1));
+}
+
+TEST(StateDispatchTable, CompressesLargeSparseTable)
+{
+    const size_t stateCount = 10000;
+    const size_t eventCount = 500;
+
+    mt19937 random(42);
+    vector<uint32_t> expected(stateCount * eventCount, StateDispatchTable::noTarget);
+
+    StateDispatchTable table;
+    table.reset(stateCount, eventCount);
+
+    // A few events per state, some states handling none.
+    for (size_t state = 0; state < stateCount; state++)
+    {
+        size_t handled = random() % 8;
+
+        for (size_t i = 0; i < handled; i++)
+        {
+            size_t event = random() % eventCount;
+            uint32_t target = static_cast<uint32_t>(random() % stateCount);
+
+            table.set(state, event, target);
+            expected[state * eventCount + event] = target;
+        }
+    }
+
+    table.compile();
+
+    CHECK(table.getLayout() == StateDispatchTable::Compressed);
+    CHECK(table.getTableBytes() * 50 < table.getDenseBytes());
+
+    bool same = true;
+
+    for (size_t state = 0; state < stateCount; state++)
+    {
+        for (size_t event = 0; event < eventCount; event++)
+        {
+            same = same && table.get(state, event) == expected[state * eventCount + event];
+        }
+    }
+
+    CHECK(same);
+
+    // The same entries in the dense layout.
+    table.compile(StateDispatchTable::Dense);
+    CHECK(table.getLayout() == StateDispatchTable::Dense);
+    CHECK_EQUAL(expected[0], table.get(0, 0));
+}
+
+TEST(StateDispatchTable, DefinitionFoldsParentEvents)
+{
+    const unsigned pause = 1;
+    const unsigned resume = 2;
+    const unsigned next = 3;
+
+    StateManager stateManager;
+    stateManager.addState("operating");
+    stateManager.addState("first");
+    stateManager.addState("second");
+    stateManager.addState("paused");
+    stateManager.setParentState("first", "operating");
+    stateManager.setParentState("second", "operating");
+    stateManager.setEventTransition("operating", pause, "paused");
+    stateManager.setEventTransition("first", next, "second");
+    stateManager.setEventTransition("paused", resume, "operating");
+
+    // The child handles the event itself instead of its parent.
+    stateManager.setEventTransition("second", pause, "first");
+    stateManager.transition("first");
+
+    StateDefinitionDomain domain(stateManager.compile());
+    StateMachine machine(domain);
+
+    CHECK_EQUAL(size_t(4 * 3), domain.getDefinition()->getEventTable().getStateCount() * domain.getDefinition()->getEventTable().getEventCount());
+    CHECK(!machine.dispatchEvent(resume));
+    CHECK(machine.dispatchEvent(next));
+    CHECK_EQUAL(string("second"), machine.getActiveStateName());
+    CHECK(machine.dispatchEvent(pause));
+    CHECK_EQUAL(string("first"), machine.getActiveStateName());
+    CHECK(machine.dispatchEvent(pause));
+    CHECK_EQUAL(string("paused"), machine.getActiveStateName());
+    CHECK(machine.dispatchEvent(resume));
+    CHECK_EQUAL(string("first"), machine.getActiveStateName());
+    CHECK(!machine.dispatchEvent(42));
+}
@@ -0,0 +1,55 @@
+#include <cstdint>
+
+#include "StateEventQueue.hpp"
+#include "TestFramework.hpp"
+
+using namespace std;
+
+TEST(StateEventQueue, HighPriorityFirst)
+{
+    StateEventQueue queue;
+    unsigned event = 0;
+
+    queue.post(1);
+    queue.post(2, StateEventQueue::High);
+
+    CHECK(queue.pop(event));
+    CHECK_EQUAL(2u, event);
+    CHECK(queue.pop(event));
+    CHECK_EQUAL(1u, event);
+    CHECK(!queue.pop(event));
+}
+
+TEST(StateEventQueue, CoalescingReplacesPendingEvent)
+{
+    StateEventQueue queue;
+    unsigned event = 0;
+
+    queue.post(10, 3, StateEventQueue::Normal);
+    queue.post(11, 3, StateEventQueue::Normal);
+
+    CHECK_EQUAL(size_t(1), queue.size());
+    CHECK_EQUAL(uint64_t(1), queue.getCoalescedEvents());
+    CHECK(queue.pop(event));
+    CHECK_EQUAL(11u, event);
+}
+
+TEST(StateEventQueue, OverflowPolicies)
+{
+    unsigned event = 0;
+
+    StateEventQueue dropNewest(2, 0, StateEventQueue::DropNewest);
+    dropNewest.post(1);
+    dropNewest.post(2);
+    CHECK(!dropNewest.post(3));
+    CHECK_EQUAL(uint64_t(1), dropNewest.getDroppedEvents());
+    CHECK(dropNewest.pop(event));
+    CHECK_EQUAL(1u, event);
+
+    StateEventQueue dropOldest(2, 0, StateEventQueue::DropOldest);
+    dropOldest.post(1);
+    dropOldest.post(2);
+    CHECK(dropOldest.post(3));
+    CHECK(dropOldest.pop(event));
+    CHECK_EQUAL(2u, event);
+}
@@ -0,0 +1,188 @@
+#include <string>
+#include <vector>
+
+#include "StateDefinitionDomain.hpp"
+#include "StateFleet.hpp"
+#include "StateManager.hpp"
+#include "TestFramework.hpp"
+
+using namespace std;
+
+namespace
+{
+    struct Device
+    {
+        int runs;
+        bool wantBusy;
+        bool wantIdle;
+
+        Device() : runs(0), wantBusy(false), wantIdle(false) {}
+    };
+
+    bool runDevice()
+    {
+        StateFleet::getContext<Device>()->runs++;
+        return true;
+    }
+
+    bool toBusy(string)
+    {
+        return StateFleet::getContext<Device>()->wantBusy;
+    }
+
+    bool always(string)
+    {
+        return true;
+    }
+
+    bool toIdle(string)
+    {
+        return StateFleet::getContext<Device>()->wantIdle;
+    }
+
+    void buildDevice(StateManager &stateManager)
+    {
+        stateManager.addState("idle");
+        stateManager.addState("busy");
+        stateManager.setStateFunction("idle", runDevice);
+        stateManager.setStateFunction("busy", runDevice);
+        stateManager.setTransitionToState("idle", toIdle);
+        stateManager.setTransitionToState("busy", toBusy);
+        stateManager.transition("idle");
+    }
+}
+
+TEST(StateFleet, BucketsFollowTransitions)
+{
+    StateManager stateManager;
+    buildDevice(stateManager);
+
+    StateDefinitionDomain domain(stateManager.compile());
+    StateFleet fleet(domain);
+
+    vector<Device> devices(100);
+
+    for (auto &device : devices)
+    {
+        fleet.addInstance(&device);
+    }
+
+    CHECK_EQUAL(size_t(100), fleet.getInstanceCount("idle"));
+
+    for (size_t i = 0; i < devices.size(); i += 3)
+    {
+        devices[i].wantBusy = true;
+    }
+
+    CHECK_EQUAL(size_t(100), fleet.run(true));
+    CHECK_EQUAL(size_t(34), fleet.getInstanceCount("busy"));
+    CHECK_EQUAL(size_t(66), fleet.getInstanceCount("idle"));
+    CHECK_EQUAL(string("busy"), fleet.getActiveStateName(3));
+    CHECK_EQUAL(string("idle"), fleet.getActiveStateName(4));
+
+    // Every instance ran exactly once, whichever bucket it moved to.
+    bool ranOnce = true;
+
+    for (auto &device : devices)
+    {
+        ranOnce = ranOnce && device.runs == 1;
+        device.wantBusy = false;
+        device.wantIdle = true;
+    }
+
+    CHECK(ranOnce);
+    CHECK(StateFleet::getContext() == nullptr);
+
+    fleet.run(true);
+    CHECK_EQUAL(size_t(100), fleet.getInstanceCount("idle"));
+    CHECK_EQUAL(2, devices[3].runs);
+}
+
+TEST(StateFleet, RemoveReusesInstances)
+{
+    StateManager stateManager;
+    buildDevice(stateManager);
+
+    StateDefinitionDomain domain(stateManager.compile());
+    StateFleet fleet(domain);
+
+    Device first;
+    Device second;
+    Device third;
+
+    fleet.addInstance(&first);
+    size_t removed = fleet.addInstance(&second);
+    fleet.transition(removed, "busy");
+
+    CHECK(fleet.removeInstance(removed));
+    CHECK(!fleet.removeInstance(removed));
+    CHECK_EQUAL(size_t(1), fleet.size());
+    CHECK_EQUAL(size_t(0), fleet.getInstanceCount("busy"));
+
+    CHECK_EQUAL(removed, fleet.addInstance(&third));
+    CHECK_EQUAL(string("idle"), fleet.getActiveStateName(removed));
+
+    fleet.run();
+    CHECK_EQUAL(0, second.runs);
+    CHECK_EQUAL(1, third.runs);
+}
+
+TEST(StateFleet, EventsAndPublishedDefinitions)
+{
+    const unsigned start = 1;
+
+    StateManager stateManager;
+    buildDevice(stateManager);
+    stateManager.setEventTransition("idle", start, "busy");
+
+    StateDefinitionDomain domain(stateManager.compile());
+    StateFleet fleet(domain);
+
+    Device devices[2];
+    fleet.addInstance(&devices[0]);
+    fleet.addInstance(&devices[1]);
+
+    CHECK(fleet.dispatchEvent(0, start));
+    CHECK(!fleet.dispatchEvent(0, start));
+    CHECK(!fleet.dispatchEvent(2, start));
+
+    // Instances keep their state by name, the ones in a state that is gone start over in the initial state.
+    stateManager.addState("maintenance");
+    stateManager.removeState("busy");
+    stateManager.transition("maintenance");
+    domain.publish(stateManager.compile());
+
+    fleet.run();
+    CHECK_EQUAL(string("maintenance"), fleet.getActiveStateName(0));
+    CHECK_EQUAL(string("idle"), fleet.getActiveStateName(1));
+
+    // The fleet moved over, so the old definition can be deleted.
+    domain.reclaim();
+    CHECK_EQUAL(size_t(0), domain.getRetiredCount());
+}
+
+TEST(StateFleet, GlobalTransitionDoesNotRestartCompositeTarget)
+{
+    StateManager stateManager;
+    stateManager.addState("idle");
+    stateManager.addState("stop");
+    stateManager.addState("s1");
+    stateManager.addState("s2");
+    stateManager.setParentState("s1", "stop");
+    stateManager.setParentState("s2", "stop");
+    stateManager.setTransitionToState("s2", always);
+    stateManager.addTransition("s1", "s2");
+    stateManager.addGlobalTransition("stop", always);
+    stateManager.transition("idle");
+
+    StateDefinitionDomain domain(stateManager.compile());
+    StateFleet fleet(domain);
+    Device device;
+    fleet.addInstance(&device);
+
+    fleet.run(true);
+    CHECK_EQUAL(string("s1"), fleet.getActiveStateName(0));
+
+    fleet.run(true);
+    CHECK_EQUAL(string("s2"), fleet.getActiveStateName(0));
+}
@@ -0,0 +1,29 @@
+#include <cstdint>
+
+#include "StateHistogram.hpp"
+#include "TestFramework.hpp"
+
+using namespace std;
+
+TEST(StateHistogram, Percentiles)
+{
+    StateHistogram histogram;
+
+    for (uint64_t value = 1; value <= 1000; value++)
+    {
+        histogram.record(value);
+    }
+
+    CHECK_EQUAL(uint64_t(1000), histogram.count());
+    CHECK_EQUAL(uint64_t(1), histogram.min());
+    CHECK_EQUAL(uint64_t(1000), histogram.max());
+
+    // Values are recorded with about 3% relative error.
+    uint64_t p99 = histogram.percentile(99);
+    CHECK(p99 >= 960 && p99 <= 1000);
+
+    StateHistogram other;
+    other.record(5000);
+    histogram.merge(other);
+    CHECK_EQUAL(uint64_t(5000), histogram.max());
+}
@@ -0,0 +1,79 @@
+#include <chrono>
+#include <string>
+
+#include "StateBlackboard.hpp"
+#include "StateManager.hpp"
+#include "StateMetrics.hpp"
+#include "TestFramework.hpp"
+
+using namespace std;
+
+// Built with STATEMANAGER_FEATURES=0, so only the core of StateManager is compiled in.
+
+namespace
+{
+    int stateRuns = 0;
+
+    bool countingState()
+    {
+        stateRuns++;
+        return true;
+    }
+
+    bool always(string)
+    {
+        return true;
+    }
+}
+
+TEST(StateManagerCore, RunsAndTransitions)
+{
+    stateRuns = 0;
+
+    StateManager stateManager;
+    stateManager.addState("ping");
+    stateManager.addState("pong");
+    stateManager.setStateFunction("ping", countingState);
+    stateManager.setStateFunction("pong", countingState);
+    stateManager.setTransitionToState("ping", always);
+    stateManager.setTransitionToState("pong", always);
+
+    CHECK(stateManager.transition("ping"));
+    CHECK(stateManager.run(true));
+    CHECK_EQUAL(string("pong"), stateManager.getActiveStateName());
+    CHECK(stateManager.run(true));
+    CHECK_EQUAL(string("ping"), stateManager.getActiveStateName());
+    CHECK_EQUAL(2, stateRuns);
+}
+
+TEST(StateManagerCore, CompiledOutFeaturesReportFailure)
+{
+    StateManager stateManager;
+    stateManager.addState("idle");
+    stateManager.addState("busy");
+
+    StateMetrics metrics;
+    StateBlackboard blackboard;
+
+    CHECK(!stateManager.setMetrics(&metrics));
+    CHECK(stateManager.setMetrics(nullptr));
+    CHECK(!stateManager.setPerfCounters(true));
+    CHECK(stateManager.setPerfCounters(false));
+    CHECK(!stateManager.setTransitionHysteresis("idle", "busy", chrono::milliseconds(10)));
+    CHECK(!stateManager.addEdgeTrigger("idle", "busy", &blackboard, "start"));
+    CHECK(!stateManager.addTransition("idle", "busy"));
+    CHECK(!stateManager.addGlobalTransition("idle", always));
+    CHECK(!stateManager.setParentState("busy", "idle"));
+    CHECK(!stateManager.setInitialState("idle", "busy"));
+    CHECK(!stateManager.setHistory("idle", StateManager::ShallowHistory));
+    CHECK(!stateManager.deferEvent("idle", 1));
+    CHECK(!stateManager.setStateLocal<int>("idle"));
+
+    stateManager.setDwellHistograms(true);
+    CHECK(stateManager.getDwellHistogram("idle") == nullptr);
+
+    // Nothing was set up, so no transition is taken on its own.
+    stateManager.transition("idle");
+    CHECK(!stateManager.transition());
+    CHECK_EQUAL(string("idle"), stateManager.getActiveStateName());
+}
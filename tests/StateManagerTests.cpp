@@ -0,0 +1,767 @@
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "StateBlackboard.hpp"
+#include "StateDefinitionDomain.hpp"
+#include "StateMachine.hpp"
+#include "StateManager.hpp"
+#include "TestFramework.hpp"
+
+using namespace std;
+
+namespace
+{
+    int stateRuns = 0;
+
+    bool countingState()
+    {
+        stateRuns++;
+        return true;
+    }
+
+    bool always(string)
+    {
+        return true;
+    }
+
+    bool wantIdle = false;
+    bool wantBusy = false;
+    bool estop = false;
+
+    bool toIdle(string)
+    {
+        return wantIdle;
+    }
+
+    bool toBusy(string)
+    {
+        return wantBusy;
+    }
+
+    bool estopPressed(string)
+    {
+        return estop;
+    }
+
+    unsigned oscillationReports = 0;
+
+    void countOscillation(const string &, const string &, unsigned)
+    {
+        oscillationReports++;
+    }
+
+    void resetFlags()
+    {
+        stateRuns = 0;
+        wantIdle = false;
+        wantBusy = false;
+        estop = false;
+    }
+}
+
+TEST(StateManager, RunWithoutStatesReturnsFalse)
+{
+    StateManager stateManager;
+
+    CHECK(!stateManager.run());
+    CHECK(!stateManager.run(true));
+    CHECK(!stateManager.transition());
+    CHECK_EQUAL(string("dummyState"), stateManager.getActiveStateName());
+}
+
+TEST(StateManager, AddStateRejectsDuplicates)
+{
+    StateManager stateManager;
+
+    CHECK(stateManager.addState("idle"));
+    CHECK(!stateManager.addState("idle"));
+    CHECK_EQUAL(size_t(1), stateManager.states.size());
+}
+
+TEST(StateManager, AddStateInitializesFunctions)
+{
+    StateManager stateManager;
+    stateManager.addState("idle");
+    stateManager.addState("busy");
+
+    // A state without functions can be entered and run, but never wants to become active on its own.
+    CHECK(!stateManager.transition());
+    CHECK(stateManager.transition("idle"));
+    CHECK(!stateManager.run(true));
+    CHECK_EQUAL(string("idle"), stateManager.getActiveStateName());
+}
+
+TEST(StateManager, RunsActiveStateAndTransitions)
+{
+    resetFlags();
+
+    StateManager stateManager;
+    stateManager.addState("idle");
+    stateManager.addState("busy");
+    stateManager.setStateFunction("busy", countingState);
+    stateManager.setTransitionToState("idle", toIdle);
+    stateManager.setTransitionToState("busy", toBusy);
+
+    stateManager.transition("idle");
+    CHECK(!stateManager.transition());
+
+    wantBusy = true;
+    CHECK(stateManager.transition());
+    CHECK_EQUAL(string("busy"), stateManager.getActiveStateName());
+
+    CHECK(stateManager.run(true));
+    CHECK_EQUAL(1, stateRuns);
+
+    // The active state is never transitioned to again.
+    CHECK_EQUAL(string("busy"), stateManager.getActiveStateName());
+}
+
+TEST(StateManager, FirstStateWins)
+{
+    StateManager stateManager;
+    stateManager.addState("a");
+    stateManager.addState("b");
+    stateManager.addState("c");
+    stateManager.setTransitionToState("b", always);
+    stateManager.setTransitionToState("c", always);
+
+    CHECK(stateManager.transition());
+    CHECK_EQUAL(string("b"), stateManager.getActiveStateName());
+}
+
+TEST(StateManager, TransitionToUnknownStateFails)
+{
+    StateManager stateManager;
+    stateManager.addState("idle");
+
+    CHECK(!stateManager.transition("missing"));
+    CHECK(!stateManager.removeState("missing"));
+    CHECK(!stateManager.setStateFunction("missing", countingState));
+    CHECK(!stateManager.setTransitionToState("missing", always));
+}
+
+TEST(StateManager, RemovingLastStateAddsDummyStateBack)
+{
+    StateManager stateManager;
+    stateManager.addState("idle");
+    stateManager.transition("idle");
+
+    CHECK(stateManager.removeState("idle"));
+    CHECK_EQUAL(size_t(1), stateManager.states.size());
+    CHECK_EQUAL(string("dummyState"), stateManager.states[0].stateName);
+    CHECK_EQUAL(string("dummyState"), stateManager.getActiveStateName());
+    CHECK(!stateManager.run(true));
+}
+
+TEST(StateManager, EnteringStatesDoesNotOverwriteDummyState)
+{
+    resetFlags();
+
+    StateManager stateManager;
+    stateManager.addState("busy");
+    stateManager.addState("other");
+    stateManager.setStateFunction("busy", countingState);
+    stateManager.transition("busy");
+
+    // The active state must be a state of its own, not the dummy state renamed.
+    CHECK(stateManager.removeState("busy"));
+    CHECK_EQUAL(string("dummyState"), stateManager.getActiveStateName());
+    CHECK(!stateManager.run());
+    CHECK_EQUAL(0, stateRuns);
+
+    stateManager.removeState("other");
+    CHECK_EQUAL(string("dummyState"), stateManager.states[0].stateName);
+    CHECK(!stateManager.run());
+}
+
+TEST(StateManager, DeclaredTransitionsOnlyFromTheirSources)
+{
+    StateManager stateManager;
+    stateManager.addState("idle");
+    stateManager.addState("busy");
+    stateManager.addState("done");
+    stateManager.setTransitionToState("done", always);
+    stateManager.addTransition("busy", "done");
+
+    stateManager.transition("idle");
+    CHECK(!stateManager.transition());
+
+    stateManager.transition("busy");
+    CHECK(stateManager.transition());
+    CHECK_EQUAL(string("done"), stateManager.getActiveStateName());
+}
+
+TEST(StateManager, GlobalTransitionsComeFirst)
+{
+    resetFlags();
+
+    StateManager stateManager;
+    stateManager.addState("idle");
+    stateManager.addState("busy");
+    stateManager.addState("stop");
+    stateManager.setTransitionToState("busy", always);
+    stateManager.addGlobalTransition("stop", estopPressed, 10);
+    stateManager.transition("idle");
+
+    estop = true;
+    CHECK(stateManager.transition());
+    CHECK_EQUAL(string("stop"), stateManager.getActiveStateName());
+}
+
+TEST(StateManager, GlobalTransitionDoesNotRestartCompositeTarget)
+{
+    resetFlags();
+
+    StateManager stateManager;
+    stateManager.addState("idle");
+    stateManager.addState("stop");
+    stateManager.addState("s1");
+    stateManager.addState("s2");
+    stateManager.setParentState("s1", "stop");
+    stateManager.setParentState("s2", "stop");
+    stateManager.setTransitionToState("s2", always);
+    stateManager.addTransition("s1", "s2");
+    stateManager.addGlobalTransition("stop", estopPressed);
+    stateManager.transition("idle");
+
+    StateDefinitionDomain domain(stateManager.compile());
+    StateMachine machine(domain);
+
+    estop = true;
+
+    // The global transition enters the composite once, then its children take over.
+    const char *expected[] = {"s1", "s2", "s2"};
+
+    for (const char *state : expected)
+    {
+        stateManager.transition();
+        machine.transition();
+
+        CHECK_EQUAL(string(state), stateManager.getActiveStateName());
+        CHECK_EQUAL(string(state), machine.getActiveStateName());
+    }
+}
+
+TEST(StateManager, Reachability)
+{
+    StateManager stateManager;
+    stateManager.addState("a");
+    stateManager.addState("b");
+    stateManager.addState("c");
+    stateManager.setTransitionToState("b", always);
+    stateManager.setTransitionToState("c", always);
+    stateManager.addTransition("a", "b");
+    stateManager.addTransition("b", "c");
+    stateManager.transition("a");
+
+    CHECK(stateManager.isReachable("a", "c"));
+    CHECK(!stateManager.isReachable("c", "a"));
+    CHECK_EQUAL(string("b"), stateManager.nextHopToward("c"));
+    CHECK_EQUAL(size_t(2), stateManager.pathToward("c").size());
+}
+
+TEST(StateManager, DeepHistory)
+{
+    StateManager stateManager;
+    stateManager.addState("operating");
+    stateManager.addState("first");
+    stateManager.addState("second");
+    stateManager.addState("paused");
+    stateManager.setParentState("first", "operating");
+    stateManager.setParentState("second", "operating");
+    stateManager.setHistory("operating", StateManager::DeepHistory);
+
+    stateManager.transition("operating");
+    CHECK_EQUAL(string("first"), stateManager.getActiveStateName());
+    CHECK(stateManager.isInState("operating"));
+
+    stateManager.transition("second");
+    stateManager.transition("paused");
+    CHECK(!stateManager.isInState("operating"));
+
+    stateManager.transition("operating");
+    CHECK_EQUAL(string("second"), stateManager.getActiveStateName());
+}
+
+TEST(StateManager, ShallowHistory)
+{
+    StateManager stateManager;
+    stateManager.addState("operating");
+    stateManager.addState("first");
+    stateManager.addState("second");
+    stateManager.addState("warmup");
+    stateManager.addState("steady");
+    stateManager.addState("paused");
+    stateManager.setParentState("first", "operating");
+    stateManager.setParentState("second", "operating");
+    stateManager.setParentState("warmup", "second");
+    stateManager.setParentState("steady", "second");
+    stateManager.setHistory("operating", StateManager::ShallowHistory);
+
+    stateManager.transition("steady");
+    stateManager.transition("paused");
+
+    // The child that was last active is restored, but entered through its initial state.
+    stateManager.transition("operating");
+    CHECK_EQUAL(string("warmup"), stateManager.getActiveStateName());
+    CHECK(stateManager.isInState("second"));
+}
+
+TEST(StateManager, ReparentingMovesTheChild)
+{
+    StateManager stateManager;
+    stateManager.addState("a");
+    stateManager.addState("b");
+    stateManager.addState("c");
+    stateManager.addState("d");
+
+    CHECK(stateManager.setParentState("b", "a"));
+    CHECK(stateManager.setParentState("d", "a"));
+    CHECK(stateManager.setParentState("b", "c"));
+
+    // a falls back to its other child.
+    stateManager.transition("a");
+    CHECK_EQUAL(string("d"), stateManager.getActiveStateName());
+
+    CHECK(stateManager.setParentState("d", "c"));
+
+    // a has no children left, so it can become a child of b without a cycle.
+    CHECK(stateManager.setParentState("a", "b"));
+    stateManager.transition("a");
+    CHECK_EQUAL(string("a"), stateManager.getActiveStateName());
+    CHECK(stateManager.isInState("c"));
+
+    stateManager.transition("c");
+    CHECK_EQUAL(string("a"), stateManager.getActiveStateName());
+
+    CHECK(!stateManager.setParentState("c", "a"));
+
+    StateDefinitionDomain domain(stateManager.compile());
+    StateMachine machine(domain);
+
+    CHECK(machine.transition("c"));
+    CHECK_EQUAL(string("a"), machine.getActiveStateName());
+}
+
+TEST(StateManager, DeferredEventsAreOfferedAgain)
+{
+    const unsigned start = 1;
+
+    StateManager stateManager;
+    stateManager.addState("booting");
+    stateManager.addState("idle");
+    stateManager.addState("busy");
+    stateManager.setEventTransition("idle", start, "busy");
+    stateManager.deferEvent("booting", start);
+    stateManager.transition("booting");
+
+    CHECK(!stateManager.dispatchEvent(start));
+    CHECK_EQUAL(size_t(1), stateManager.getDeferredEventCount());
+
+    stateManager.transition("idle");
+    CHECK_EQUAL(string("busy"), stateManager.getActiveStateName());
+    CHECK_EQUAL(size_t(0), stateManager.getDeferredEventCount());
+}
+
+TEST(StateManager, SubstateHandlingOverridesInheritedDeferral)
+{
+    const unsigned event = 7;
+
+    StateManager stateManager;
+    stateManager.addState("p");
+    stateManager.addState("c1");
+    stateManager.addState("c2");
+    stateManager.addState("done");
+    stateManager.setParentState("c1", "p");
+    stateManager.setParentState("c2", "p");
+    stateManager.deferEvent("p", event);
+    stateManager.setEventTransition("c2", event, "done");
+    stateManager.transition("c1");
+
+    CHECK(!stateManager.dispatchEvent(event));
+    CHECK_EQUAL(size_t(1), stateManager.getDeferredEventCount());
+
+    // c2 inherits the deferral of p, but handles the event itself.
+    stateManager.transition("c2");
+    CHECK_EQUAL(string("done"), stateManager.getActiveStateName());
+    CHECK_EQUAL(size_t(0), stateManager.getDeferredEventCount());
+}
+
+TEST(StateManager, EventQueue)
+{
+    const unsigned start = 1;
+
+    StateEventQueue queue;
+    StateManager stateManager;
+    stateManager.addState("idle");
+    stateManager.addState("busy");
+    stateManager.setEventTransition("idle", start, "busy");
+    stateManager.setEventQueue(&queue);
+    stateManager.transition("idle");
+
+    queue.post(start);
+    CHECK_EQUAL(size_t(1), stateManager.processEvents());
+    CHECK_EQUAL(string("busy"), stateManager.getActiveStateName());
+}
+
+TEST(StateManager, HysteresisNeedsConsecutiveTrue)
+{
+    StateManager stateManager;
+    stateManager.addState("idle");
+    stateManager.addState("busy");
+    stateManager.setTransitionToState("busy", always);
+    stateManager.setTransitionHysteresis("idle", "busy", chrono::nanoseconds::zero(), 3);
+    stateManager.transition("idle");
+
+    CHECK(!stateManager.transition());
+    CHECK(!stateManager.transition());
+    CHECK(stateManager.transition());
+}
+
+TEST(StateManager, HysteresisNeedsMinimumDwell)
+{
+    StateManager stateManager;
+    stateManager.addState("idle");
+    stateManager.addState("busy");
+    stateManager.setTransitionToState("busy", always);
+    stateManager.setTransitionHysteresis("idle", "busy", chrono::milliseconds(20));
+    stateManager.transition("idle");
+
+    CHECK(!stateManager.transition());
+    CHECK_EQUAL(string("idle"), stateManager.getActiveStateName());
+
+    this_thread::sleep_for(chrono::milliseconds(30));
+    CHECK(stateManager.transition());
+    CHECK_EQUAL(string("busy"), stateManager.getActiveStateName());
+}
+
+TEST(StateManager, PruneRemovesUnreachableStates)
+{
+    StateManager stateManager;
+    stateManager.addState("a");
+    stateManager.addState("b");
+    stateManager.addState("island");
+    stateManager.setTransitionToState("b", always);
+    stateManager.addTransition("a", "b");
+    stateManager.transition("a");
+
+    StateManager::PruneReport report = stateManager.prune();
+
+    CHECK_EQUAL(size_t(3), report.statesBefore);
+    CHECK_EQUAL(size_t(2), report.statesAfter);
+    CHECK(stateManager.transition());
+    CHECK_EQUAL(string("b"), stateManager.getActiveStateName());
+}
+
+TEST(StateManager, EdgeTriggerTakesRisingEdgeOnce)
+{
+    StateBlackboard blackboard;
+    StateManager stateManager;
+    stateManager.addState("idle");
+    stateManager.addState("busy");
+    CHECK(stateManager.addEdgeTrigger("idle", "busy", &blackboard, "button"));
+    stateManager.transition("idle");
+
+    CHECK(!stateManager.transition());
+
+    blackboard.setInput("button", true);
+    CHECK(stateManager.transition());
+    CHECK_EQUAL(string("busy"), stateManager.getActiveStateName());
+
+    // The input staying true is not another edge.
+    stateManager.transition("idle");
+    blackboard.setInput("button", true);
+    CHECK(!stateManager.transition());
+
+    // An edge while the source state is not active is dropped.
+    stateManager.transition("busy");
+    blackboard.setInput("button", false);
+    blackboard.setInput("button", true);
+    CHECK(!stateManager.transition());
+    stateManager.transition("idle");
+    CHECK(!stateManager.transition());
+
+    blackboard.setInput("button", false);
+    blackboard.setInput("button", true);
+    CHECK(stateManager.transition());
+    CHECK_EQUAL(string("busy"), stateManager.getActiveStateName());
+}
+
+TEST(StateManager, PruneSkipsTriggersOfRemovedStates)
+{
+    StateBlackboard blackboard;
+    StateManager stateManager;
+    stateManager.addState("a");
+    stateManager.addState("b");
+    stateManager.addEdgeTrigger("a", "b", &blackboard, "button");
+    stateManager.transition("a");
+
+    CHECK(stateManager.removeState("b"));
+
+    StateManager::PruneReport report = stateManager.prune();
+
+    CHECK_EQUAL(size_t(0), report.removedTransitions.size());
+
+    // The trigger is no longer subscribed, so the rising edge goes nowhere.
+    blackboard.setInput("button", true);
+    CHECK(!stateManager.transition());
+    CHECK_EQUAL(string("a"), stateManager.getActiveStateName());
+}
+
+TEST(StateManager, PrunedTriggersUnsubscribe)
+{
+    StateBlackboard blackboard;
+
+    {
+        StateManager stateManager;
+        stateManager.addState("idle");
+        stateManager.addState("busy");
+        stateManager.addState("orphan");
+        stateManager.setTransitionToState("busy", always);
+        stateManager.addEdgeTrigger("orphan", "idle", &blackboard, "button");
+        stateManager.transition("idle");
+
+        StateManager::PruneReport report = stateManager.prune();
+
+        CHECK_EQUAL(size_t(2), report.statesAfter);
+        CHECK_EQUAL(size_t(1), report.removedTransitions.size());
+    }
+
+    // The state manager is gone: the blackboard must not notify it anymore.
+    CHECK(blackboard.setInput("button", true));
+}
+
+TEST(StateManager, OscillationDetection)
+{
+    oscillationReports = 0;
+
+    StateManager stateManager;
+    stateManager.addState("left");
+    stateManager.addState("right");
+    stateManager.setOscillationDetection(chrono::seconds(60), 3, countOscillation);
+
+    for (int i = 0; i < 4; i++)
+    {
+        stateManager.transition("left");
+        stateManager.transition("right");
+    }
+
+    // Reported once per window and edge.
+    CHECK_EQUAL(2u, oscillationReports);
+
+    vector<StateManager::Oscillation> oscillating = stateManager.getOscillatingEdges();
+    CHECK_EQUAL(size_t(2), oscillating.size());
+
+    for (size_t i = 0; i < oscillating.size(); i++)
+    {
+        CHECK(oscillating[i].transitions >= 3);
+    }
+
+    stateManager.setOscillationDetection(chrono::nanoseconds(0), 3, countOscillation);
+    stateManager.transition("left");
+    CHECK_EQUAL(2u, oscillationReports);
+}
+
+TEST(StateManager, CloneCopiesStateAndHistory)
+{
+    StateManager stateManager;
+    stateManager.addState("operating");
+    stateManager.addState("first");
+    stateManager.addState("second");
+    stateManager.addState("paused");
+    stateManager.setParentState("first", "operating");
+    stateManager.setParentState("second", "operating");
+    stateManager.setHistory("operating", StateManager::DeepHistory);
+
+    StateDefinitionDomain domain(stateManager.compile());
+    StateMachine machine(domain);
+    machine.transition("second");
+    machine.transition("paused");
+
+    StateMachine *clone = machine.clone();
+    CHECK_EQUAL(string("paused"), clone->getActiveStateName());
+
+    clone->transition("operating");
+    CHECK_EQUAL(string("second"), clone->getActiveStateName());
+
+    // The clone runs on its own.
+    CHECK_EQUAL(string("paused"), machine.getActiveStateName());
+
+    delete clone;
+}
+
+TEST(StateManager, MetricsCountTicksAndTransitions)
+{
+    StateMetrics metrics;
+    StateManager stateManager;
+    stateManager.addState("idle");
+    stateManager.addState("busy");
+    stateManager.setTransitionToState("busy", always);
+    CHECK(stateManager.setMetrics(&metrics, "test"));
+    stateManager.transition("idle");
+
+    stateManager.run(true);
+
+    string text = metrics.toPrometheus();
+    CHECK(text.find("statemanager_ticks_total{machine=\"test\"} 1") != string::npos);
+    CHECK(text.find("statemanager_transitions_total{machine=\"test\",from=\"idle\",to=\"busy\"} 1") != string::npos);
+}
+
+TEST(StateManager, MetricsAreRegisteredUpFront)
+{
+    StateMetrics metrics;
+    StateManager stateManager;
+    stateManager.addState("a");
+    stateManager.addState("b");
+    stateManager.addState("c");
+    stateManager.setTransitionToState("b", always);
+    stateManager.setTransitionToState("c", always);
+    stateManager.addTransition("b", "c");
+    CHECK(stateManager.setMetrics(&metrics, "test"));
+
+    // b -> c is declared, so its counter exists before it is taken.
+    CHECK(metrics.toPrometheus().find("from=\"b\",to=\"c\"} 0") != string::npos);
+
+    size_t registered = metrics.size();
+
+    // dummyState -> a, a -> b and c -> a are not declared: they get a counter when first taken.
+    stateManager.transition("a");
+    stateManager.run(true);
+    stateManager.run(true);
+    stateManager.transition("a");
+
+    CHECK_EQUAL(registered + 3, metrics.size());
+
+    stateManager.run(true);
+    CHECK_EQUAL(registered + 3, metrics.size());
+
+    string text = metrics.toPrometheus();
+    CHECK(text.find("statemanager_transitions_total{machine=\"test\",from=\"b\",to=\"c\"} 1") != string::npos);
+    CHECK(text.find("statemanager_transitions_total{machine=\"test\",from=\"a\",to=\"b\"} 2") != string::npos);
+    CHECK(text.find("statemanager_transitions_unregistered_total{machine=\"test\"} 0") != string::npos);
+
+    // A family is exported under a single header.
+    CHECK_EQUAL(text.find("# TYPE statemanager_transitions_total"), text.rfind("# TYPE statemanager_transitions_total"));
+}
+
+TEST(StateManager, MetricsFitMachinesWithoutDeclaredTransitions)
+{
+    const size_t stateCount = 40;
+
+    StateMetrics metrics;
+    StateManager stateManager;
+
+    for (size_t i = 0; i < stateCount; i++)
+    {
+        stateManager.addState("s" + to_string(i));
+        stateManager.setTransitionToState("s" + to_string(i), always);
+    }
+
+    // Every state can be entered from every other one: 40 * 39 edges would not fit in the registry.
+    CHECK(stateManager.setMetrics(&metrics, "test"));
+    CHECK(metrics.size() < 1024);
+
+    for (size_t i = 0; i < stateCount; i++)
+    {
+        stateManager.transition("s" + to_string(i));
+    }
+
+    string text = metrics.toPrometheus();
+    CHECK(text.find("statemanager_transitions_total{machine=\"test\",from=\"s38\",to=\"s39\"} 1") != string::npos);
+    CHECK(text.find("statemanager_transitions_unregistered_total{machine=\"test\"} 0") != string::npos);
+}
+
+TEST(StateManager, TransitionsWithoutRoomForACounterAreUnregistered)
+{
+    // Room for the counters of the state manager and its states, but not for a transition counter.
+    StateMetrics metrics(6 + 3 * 3);
+    StateManager stateManager;
+    stateManager.addState("a");
+    stateManager.addState("b");
+    CHECK(stateManager.setMetrics(&metrics, "test"));
+
+    stateManager.transition("a");
+    stateManager.transition("b");
+
+    CHECK(metrics.toPrometheus().find("statemanager_transitions_unregistered_total{machine=\"test\"} 2") != string::npos);
+}
+
+TEST(StateManager, DwellHistograms)
+{
+    StateManager stateManager;
+    stateManager.addState("idle");
+    stateManager.addState("busy");
+    stateManager.setDwellHistograms(true);
+    stateManager.transition("idle");
+    stateManager.transition("busy");
+
+    CHECK(stateManager.getDwellHistogram("idle") != nullptr);
+    CHECK_EQUAL(uint64_t(1), stateManager.getDwellHistogram("idle")->count());
+    CHECK(stateManager.getDwellHistogram("missing") == nullptr);
+}
+
+namespace
+{
+    struct Scratch
+    {
+        int value;
+
+        Scratch() : value(42) {}
+    };
+
+    int liveCounters = 0;
+
+    struct Counted
+    {
+        Counted()
+        {
+            liveCounters++;
+        }
+
+        ~Counted()
+        {
+            liveCounters--;
+        }
+    };
+}
+
+TEST(StateManager, StateLocalStorageLivesWhileStateIsActive)
+{
+    StateManager stateManager;
+    stateManager.addState("idle");
+    stateManager.addState("busy");
+    CHECK(stateManager.setStateLocal<Scratch>("idle", 64));
+    CHECK(stateManager.setStateLocal<Counted>("busy"));
+
+    stateManager.transition("idle");
+    CHECK(stateManager.getStateLocal<Scratch>() != nullptr);
+    CHECK(stateManager.getStateLocal<Counted>() == nullptr);
+    CHECK_EQUAL(42, stateManager.getStateLocal<Scratch>()->value);
+    CHECK(stateManager.allocateInState(32) != nullptr);
+
+    stateManager.getStateLocal<Scratch>()->value = 7;
+
+    stateManager.transition("busy");
+    CHECK_EQUAL(1, liveCounters);
+
+    // Entering a state again constructs its storage again.
+    stateManager.transition("idle");
+    CHECK_EQUAL(0, liveCounters);
+    CHECK_EQUAL(42, stateManager.getStateLocal<Scratch>()->value);
+}
+
+TEST(StateManager, StateScratchWithoutLocalStorage)
+{
+    StateManager stateManager;
+    stateManager.addState("idle");
+    stateManager.transition("idle");
+
+    // Nothing made room in the arena yet.
+    CHECK(stateManager.allocateInState(16) == nullptr);
+
+    stateManager.reserveStateScratch(64);
+    CHECK(stateManager.allocateInState(16) != nullptr);
+    CHECK(stateManager.getStateLocal<Scratch>() == nullptr);
+}
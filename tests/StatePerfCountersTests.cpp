@@ -0,0 +1,98 @@
+#include <cstdint>
+#include <string>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "StateManager.hpp"
+#include "StatePerfCounters.hpp"
+#include "TestFramework.hpp"
+
+using namespace std;
+
+#ifdef __linux__
+
+namespace
+{
+    // Lowers the file descriptor limit, so perf_event_open can only open a given number of counters.
+    class FileLimit
+    {
+    public:
+        FileLimit(int freeDescriptors)
+        {
+            getrlimit(RLIMIT_NOFILE, &saved);
+
+            // The lowest free descriptor: every descriptor below it is taken.
+            int lowest = dup(0);
+            close(lowest);
+
+            struct rlimit limit = saved;
+            limit.rlim_cur = static_cast<rlim_t>(lowest + freeDescriptors);
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+
+        ~FileLimit()
+        {
+            setrlimit(RLIMIT_NOFILE, &saved);
+        }
+
+    private:
+        struct rlimit saved;
+    };
+
+    bool always(string)
+    {
+        return true;
+    }
+}
+
+TEST(StatePerfCounters, UnavailableCountersReadZero)
+{
+    FileLimit limit(0);
+
+    StatePerfCounters counters;
+    CHECK(!counters.available());
+
+    StatePerfCounters::Sample sample;
+    sample.cycles = 1;
+    CHECK(!counters.read(sample));
+    CHECK_EQUAL(uint64_t(0), sample.cycles);
+    CHECK_EQUAL(uint64_t(0), sample.instructions);
+
+    StateManager stateManager;
+    stateManager.addState("a");
+    stateManager.addState("b");
+    stateManager.setTransitionToState("b", always);
+    CHECK(!stateManager.setPerfCounters(true));
+
+    stateManager.transition("a");
+    CHECK(stateManager.transition());
+    CHECK(!stateManager.getPerfCounters("a", sample));
+}
+
+TEST(StatePerfCounters, PartialGroupReadsOpenedCounters)
+{
+    // Only the cycle counter leading the group can be opened.
+    FileLimit limit(1);
+
+    StatePerfCounters counters;
+    StatePerfCounters::Sample sample;
+
+    if (counters.available())
+    {
+        CHECK(counters.read(sample));
+        CHECK_EQUAL(uint64_t(0), sample.instructions);
+        CHECK_EQUAL(uint64_t(0), sample.cacheMisses);
+        CHECK_EQUAL(uint64_t(0), sample.branchMisses);
+    }
+    else
+    {
+        // Perf events are not available here at all.
+        CHECK(!counters.read(sample));
+        CHECK_EQUAL(uint64_t(0), sample.cycles);
+    }
+}
+
+#endif
@@ -0,0 +1,266 @@
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BasicStateManager.hpp"
+#include "StateDefinitionDomain.hpp"
+#include "StateEventQueue.hpp"
+#include "StateMachine.hpp"
+#include "StateManager.hpp"
+#include "StateMetrics.hpp"
+#include "TestFramework.hpp"
+
+using namespace std;
+
+namespace
+{
+    const unsigned threadCount = 4;
+
+    bool always(string)
+    {
+        return true;
+    }
+
+    bool running()
+    {
+        return true;
+    }
+}
+
+TEST(Stress, EventQueueKeepsEveryEventInOrder)
+{
+    const unsigned eventsPerProducer = 20000;
+
+    // A small queue, so producers keep running into the Block policy.
+    StateEventQueue queue(64, 0, StateEventQueue::Block);
+    vector<thread> producers;
+
+    for (unsigned p = 0; p < threadCount; p++)
+    {
+        producers.push_back(thread([&queue, p]() {
+            for (unsigned i = 0; i < eventsPerProducer; i++)
+            {
+                queue.post(p * eventsPerProducer + i, i % 8 == 0 ? StateEventQueue::High : StateEventQueue::Normal);
+            }
+        }));
+    }
+
+    // Events of one producer and one lane come out in the order they were posted.
+    vector<unsigned> lastSeen(threadCount * 2, 0);
+    vector<bool> seenAny(threadCount * 2, false);
+    unsigned received = 0;
+    bool ordered = true;
+
+    while (received < threadCount * eventsPerProducer)
+    {
+        unsigned event;
+
+        if (!queue.pop(event))
+        {
+            this_thread::yield();
+            continue;
+        }
+
+        unsigned producer = event / eventsPerProducer;
+        unsigned lane = producer * 2 + ((event % eventsPerProducer) % 8 == 0 ? 1 : 0);
+
+        ordered = ordered && (!seenAny[lane] || event > lastSeen[lane]);
+        lastSeen[lane] = event;
+        seenAny[lane] = true;
+        received++;
+    }
+
+    for (auto &producer : producers)
+    {
+        producer.join();
+    }
+
+    unsigned event;
+
+    CHECK(ordered);
+    CHECK(!queue.pop(event));
+    CHECK_EQUAL(uint64_t(0), queue.getDroppedEvents());
+}
+
+TEST(Stress, MetricsCountFromEveryThread)
+{
+    const unsigned incrementsPerThread = 100000;
+
+    StateMetrics metrics;
+    StateMetrics::MetricId counter = metrics.addCounter("stress_total", "Stress test counter.");
+    atomic<bool> done(false);
+
+    // Reading and exporting while the counters change must be safe.
+    thread reader([&]() {
+        while (!done.load())
+        {
+            metrics.read(counter);
+            metrics.toPrometheus();
+        }
+    });
+
+    vector<thread> writers;
+
+    for (unsigned t = 0; t < threadCount; t++)
+    {
+        writers.push_back(thread([&]() {
+            for (unsigned i = 0; i < incrementsPerThread; i++)
+            {
+                metrics.increment(counter);
+            }
+        }));
+    }
+
+    for (auto &writer : writers)
+    {
+        writer.join();
+    }
+
+    done.store(true);
+    reader.join();
+
+    CHECK_EQUAL(uint64_t(threadCount) * incrementsPerThread, metrics.read(counter));
+}
+
+TEST(Stress, MachinesFollowPublishedDefinitions)
+{
+    const unsigned publications = 200;
+
+    StateManager stateManager;
+    stateManager.addState("idle");
+    stateManager.addState("busy");
+    stateManager.setStateFunction("idle", running);
+    stateManager.setStateFunction("busy", running);
+    stateManager.setTransitionToState("busy", always);
+    stateManager.transition("idle");
+
+    StateDefinitionDomain domain(stateManager.compile());
+    atomic<bool> done(false);
+    atomic<unsigned> failures(0);
+    vector<thread> machines;
+
+    for (unsigned t = 0; t < threadCount; t++)
+    {
+        machines.push_back(thread([&]() {
+            StateMachine machine(domain);
+
+            while (!done.load())
+            {
+                StateMachine *clone = machine.clone();
+
+                // Every definition has both states, so the machine always has one active.
+                if (!machine.run(true) || !clone->run())
+                {
+                    failures++;
+                }
+
+                delete clone;
+            }
+
+            machine.update();
+
+            if (machine.getGeneration() != domain.getDefinition()->getGeneration())
+            {
+                failures++;
+            }
+        }));
+    }
+
+    for (unsigned i = 0; i < publications; i++)
+    {
+        domain.publish(stateManager.compile());
+    }
+
+    done.store(true);
+
+    for (auto &machine : machines)
+    {
+        machine.join();
+    }
+
+    CHECK_EQUAL(0u, failures.load());
+
+    // Every machine is gone, so every retired definition can be deleted.
+    domain.reclaim();
+    CHECK_EQUAL(size_t(0), domain.getRetiredCount());
+}
+
+TEST(Stress, StateManagerConsumesEventsFromProducers)
+{
+    const unsigned eventsPerProducer = 5000;
+    const unsigned toggle = 1;
+
+    StateEventQueue queue(256, 0, StateEventQueue::Block);
+    StateManager stateManager;
+    stateManager.addState("a");
+    stateManager.addState("b");
+    stateManager.setStateFunction("a", running);
+    stateManager.setStateFunction("b", running);
+    stateManager.setEventTransition("a", toggle, "b");
+    stateManager.setEventTransition("b", toggle, "a");
+    stateManager.setEventQueue(&queue);
+    stateManager.transition("a");
+
+    vector<thread> producers;
+
+    for (unsigned p = 0; p < threadCount; p++)
+    {
+        producers.push_back(thread([&queue]() {
+            for (unsigned i = 0; i < eventsPerProducer; i++)
+            {
+                queue.post(toggle);
+            }
+        }));
+    }
+
+    size_t dispatched = 0;
+
+    while (dispatched < threadCount * eventsPerProducer)
+    {
+        dispatched += stateManager.processEvents(64);
+        stateManager.run();
+    }
+
+    for (auto &producer : producers)
+    {
+        producer.join();
+    }
+
+    // An even number of toggles brings the state manager back to where it started.
+    CHECK_EQUAL(string("a"), stateManager.getActiveStateName());
+}
+
+TEST(Stress, MultiThreadedBasicStateManager)
+{
+    const unsigned ticksPerThread = 20000;
+
+    BasicStateManager<MultiThreaded, CountingInstrumentation> stateManager;
+    stateManager.addState("a");
+    stateManager.addState("b");
+    stateManager.setStateFunction("a", running);
+    stateManager.setStateFunction("b", running);
+    stateManager.setTransitionToState("a", always);
+    stateManager.setTransitionToState("b", always);
+
+    vector<thread> threads;
+
+    for (unsigned t = 0; t < threadCount; t++)
+    {
+        threads.push_back(thread([&stateManager]() {
+            for (unsigned i = 0; i < ticksPerThread; i++)
+            {
+                stateManager.run(true);
+            }
+        }));
+    }
+
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    CHECK_EQUAL(uint64_t(threadCount) * ticksPerThread, stateManager.getInstrumentation().ticks);
+    CHECK_EQUAL(uint64_t(threadCount) * ticksPerThread, stateManager.getInstrumentation().transitions);
+}
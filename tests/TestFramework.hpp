@@ -0,0 +1,82 @@
+/**
+ * @brief A minimal test framework for the StateManager tests.
+ * @author Honzik Schenk
+ *
+ * TEST(Suite, Name) defines and registers a test, CHECK(condition) fails it.
+ * TestMain.cpp runs every registered test, or only the tests of the suites
+ * named on the command line, and exits with a non-zero status if any test
+ * failed. There is nothing to install, so the tests build wherever the
+ * library builds.
+ */
+
+#ifndef TESTFRAMEWORK_HPP
+#define TESTFRAMEWORK_HPP
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct TestCase
+{
+    string suite;
+    string name;
+    void (*function)();
+};
+
+/**
+ * @brief Get every registered test, in the order they were registered.
+ */
+vector<TestCase> &testCases();
+
+struct TestRegistration
+{
+    TestRegistration(const char *suite, const char *name, void (*function)())
+    {
+        TestCase test;
+        test.suite = suite;
+        test.name = name;
+        test.function = function;
+
+        testCases().push_back(test);
+    }
+};
+
+/**
+ * @brief Thrown by CHECK() to fail the running test.
+ */
+struct TestFailure
+{
+    string message;
+};
+
+#define TEST(suite, name)                                                   \
+    static void suite##_##name();                                           \
+    static TestRegistration suite##_##name##_registration(#suite, #name, suite##_##name); \
+    static void suite##_##name()
+
+#define CHECK(condition)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if (!(condition))                                                   \
+        {                                                                   \
+            ostringstream checkMessage;                                     \
+            checkMessage << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed"; \
+            throw TestFailure{checkMessage.str()};                          \
+        }                                                                   \
+    } while (false)
+
+#define CHECK_EQUAL(expected, actual)                                       \
+    do                                                                      \
+    {                                                                       \
+        if (!((expected) == (actual)))                                      \
+        {                                                                   \
+            ostringstream checkMessage;                                     \
+            checkMessage << __FILE__ << ":" << __LINE__ << ": CHECK_EQUAL(" #expected ", " #actual ") failed: " \
+                         << (expected) << " != " << (actual);               \
+            throw TestFailure{checkMessage.str()};                          \
+        }                                                                   \
+    } while (false)
+
+#endif // TESTFRAMEWORK_HPP
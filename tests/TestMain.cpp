@@ -0,0 +1,63 @@
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TestFramework.hpp"
+
+using namespace std;
+
+vector<TestCase> &testCases()
+{
+    static vector<TestCase> tests;
+
+    return tests;
+}
+
+int main(int argc, char **argv)
+{
+    vector<string> suites(argv + 1, argv + argc);
+
+    size_t run = 0;
+    size_t failed = 0;
+
+    for (auto &test : testCases())
+    {
+        bool selected = suites.empty();
+
+        for (auto &suite : suites)
+        {
+            selected = selected || suite == test.suite;
+        }
+
+        if (!selected)
+        {
+            continue;
+        }
+
+        run++;
+
+        try
+        {
+            test.function();
+        }
+        catch (const TestFailure &failure)
+        {
+            failed++;
+            cerr << "FAILED " << test.suite << "." << test.name << "\n  " << failure.message << endl;
+            continue;
+        }
+        catch (const exception &e)
+        {
+            failed++;
+            cerr << "FAILED " << test.suite << "." << test.name << "\n  exception: " << e.what() << endl;
+            continue;
+        }
+
+        cout << "passed " << test.suite << "." << test.name << endl;
+    }
+
+    cout << run - failed << " of " << run << " tests passed" << endl;
+
+    return failed == 0 && run > 0 ? 0 : 1;
+}